@@ -0,0 +1,166 @@
+/*
+ * bench_logpump.c : throughput and system calls of the log pump engines.
+ *
+ *  usage : bench_logpump [ -w workers ] [ -p pipes ] [ -m MB ] [ -c chunk ]
+ *
+ *  writer threads push MB of 100 byte lines, chunk bytes a write(), into
+ *  the pipes, and the pump writes them to /dev/null. the same load is run
+ *  on epoll and on io_uring, and by the shared memory rings ( shmlog.h )
+ *  instead of the pipes. waits are epoll_wait() or io_uring_enter(),
+ *  reads are read() of the pipes, chunks are write() to the log file.
+ */
+#include "logpump.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+static long   total;    /* bytes for each pipe */
+static int    chunk = 4096;
+
+static int64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * into the ring, waits while it is full.
+ */
+static void *shm_writer( void *arg )
+{
+    struct shmlog *l = arg;
+    char  *buff = malloc( chunk );
+    long   n;
+    int    i;
+
+    for( i = 0 ; i < chunk ; i ++ ) buff[i] = ( i % 100 == 99 ) ? '\n' : 'a' + i % 26;
+    for( n = 0 ; n < total ; n += chunk )
+    {
+        while( shmlog_write( l, buff, chunk ) < 0 ) sched_yield();
+    }
+    shmlog_detach( l );
+    free( buff );
+    return NULL;
+}
+
+static void *writer( void *arg )
+{
+    char  *buff = malloc( chunk );
+    long   n;
+    int    fd = (int)(intptr_t)arg, i;
+
+    for( i = 0 ; i < chunk ; i ++ ) buff[i] = ( i % 100 == 99 ) ? '\n' : 'a' + i % 26;
+    for( n = 0 ; n < total ; n += chunk )
+    {
+        if( write( fd, buff, chunk ) != chunk ) break;
+    }
+    close( fd );
+    free( buff );
+    return NULL;
+}
+
+static int run( const char *name, int uring, int shm, int nworkers, int npipes )
+{
+    struct logpump  *p;
+    struct logfile  *f = logfile_new( "/dev/null" );
+    struct logpipe **lps = calloc( sizeof( struct logpipe * ), npipes );
+    struct shmlog  **rings = calloc( sizeof( struct shmlog * ), npipes );
+    pthread_t       *th  = calloc( sizeof( pthread_t ), npipes );
+    struct rusage    r0, r1;
+    uint64_t         bytes, waits = 0, reads = 0, chunks = 0;
+    int64_t          t0, t;
+    int              i, fds[2];
+
+    p = logpump_start( nworkers, 0, NULL, uring );
+    if( p == NULL || f == NULL || lps == NULL || rings == NULL || th == NULL ) return -1;
+    if( uring && p->uring == 0 )
+    {
+        printf( "%-9s not available on this kernel.\n", name );
+        return 0;
+    }
+    getrusage( RUSAGE_SELF, &r0 );
+    t0 = now_ns();
+    for( i = 0 ; i < npipes ; i ++ )
+    {
+        if( shm )
+        {
+            struct shmlog *l;
+
+            // 4 MB, a pipe takes 64 KB but the writer is not blocked.
+            if( !( rings[i] = shmlog_create( 4 * 1024 * 1024 ) )
+             || !( l = shmlog_open( rings[i]->memfd, rings[i]->evfd ) ) ) return -1;
+            lps[i] = logpump_add_shm( p, rings[i], f, NULL, NULL, NULL, NULL );
+            pthread_create( &th[i], NULL, shm_writer, l );
+            continue;
+        }
+        if( pipe( fds ) < 0 ) return -1;
+        lps[i] = logpump_add( p, fds[0], f, NULL, NULL, NULL, NULL );
+        pthread_create( &th[i], NULL, writer, (void *)(intptr_t)fds[1] );
+    }
+    for( i = 0 ; i < npipes ; i ++ ) pthread_join( th[i], NULL );
+    do{
+        for( i = 0, bytes = 0 ; i < npipes ; i ++ ) bytes += logpump_bytes( lps[i] );
+    }while( bytes < (uint64_t)total * npipes && ( usleep( 100 ), 1 ) );
+    t = now_ns() - t0;
+    getrusage( RUSAGE_SELF, &r1 );
+
+    for( i = 0 ; i < p->nworkers ; i ++ )
+    {
+        waits  += p->workers[i].waits;
+        reads  += p->workers[i].reads;
+        chunks += p->workers[i].chunks;
+    }
+    printf( "%-9s %7.1f MB %7.3f sec %8.1f MB/s  waits %8llu reads %8llu writes %8llu  syscalls/MB %7.1f  ctxsw %ld\n",
+            name, bytes / 1048576.0, t / 1e9, bytes / 1048576.0 / ( t / 1e9 ),
+            (unsigned long long)waits, (unsigned long long)reads, (unsigned long long)chunks,
+            ( waits + reads + chunks ) / ( bytes / 1048576.0 ),
+            ( r1.ru_nvcsw + r1.ru_nivcsw ) - ( r0.ru_nvcsw + r0.ru_nivcsw ) );
+
+    for( i = 0 ; i < npipes ; i ++ ) logpump_detach( p, lps[i] );
+    logpump_stop( p );
+    for( i = 0 ; i < npipes ; i ++ )
+    {
+        if( rings[i] == NULL ) continue;
+        close( rings[i]->memfd );
+        close( rings[i]->evfd );
+        shmlog_detach( rings[i] );
+    }
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    int  c, nworkers = 1, npipes = 8;
+    long mb = 256;
+
+    while( ( c = getopt( argc, argv, "w:p:m:c:" ) ) != EOF )
+    {
+        switch( c )
+        {
+        case 'w': nworkers = atoi( optarg ); break;
+        case 'p': npipes   = atoi( optarg ); break;
+        case 'm': mb       = atol( optarg ); break;
+        case 'c': chunk    = atoi( optarg ); break;
+        default :
+            fprintf( stderr, "usage : %s [ -w workers ] [ -p pipes ] [ -m MB ] [ -c chunk ]\n", argv[0] );
+            return 1;
+        }
+    }
+    if( nworkers < 1 || npipes < 1 || mb < 1 || chunk < 100 ) return 1;
+    total = mb * 1048576 / npipes;
+
+    printf( "%d workers, %d pipes, %ld MB, %d bytes a write.\n", nworkers, npipes, mb, chunk );
+    if( run( "epoll", 0, 0, nworkers, npipes ) < 0 || run( "io_uring", 1, 0, nworkers, npipes ) < 0
+     || run( "shmlog", 0, 1, nworkers, npipes ) < 0 || run( "shm+uring", 1, 1, nworkers, npipes ) < 0 )
+    {
+        perror( "bench_logpump" );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * bench_restart.c : restart latency of watcher, optionally under memory pressure.
+ *
+ *  usage : bench_restart [ -n # ] [ -m MB ] watcher [ option ... ]
+ *
+ *    -n #  : measure # restarts. ( default 20 )
+ *    -m MB : a hog process keeps touching MB of memory meanwhile.
+ *
+ *  watcher runs this program itself as the command, which stamps the
+ *  time and exits at once. the gap between two stamps minus the restart
+ *  delay is the cost of watcher: reap, timer, fork and exec.
+ *  compare e.g. "bench_restart -m 4096 ./watcher" and "... ./watcher -M".
+ */
+#include "watcher.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static int64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp( const void *a, const void *b )
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*
+ * the command run by watcher.
+ */
+static void stamp( const char *path )
+{
+    int64_t t = now_ns();
+    int     fd = open( path, O_WRONLY | O_APPEND );
+
+    if( fd >= 0 ) write( fd, &t, sizeof( t ) );
+    exit( 0 );
+}
+
+static pid_t hog( long mb )
+{
+    pid_t  pid = fork();
+    size_t siz = (size_t)mb << 20, i;
+    char  *p;
+
+    if( pid != 0 ) return pid;
+
+    p = malloc( siz );
+    if( p == NULL ) exit( 1 );
+    for(;;)
+    {
+        for( i = 0 ; i < siz ; i += 4096 ) p[i] ++;
+    }
+}
+
+static long rss_of( pid_t pid )
+{
+    char  path[64], line[128];
+    long  rss = -1;
+    FILE *fp;
+
+    snprintf( path, sizeof( path ), "/proc/%d/status", (int)pid );
+    if( ( fp = fopen( path, "r" ) ) == NULL ) return -1;
+    while( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+        if( strncmp( line, "VmRSS:", 6 ) == 0 ) rss = atol( line + 6 );
+    }
+    fclose( fp );
+    return rss;
+}
+
+int main( int argc, char *argv[] )
+{
+    char     self[1024], stamps[64] = "/tmp/bench_restart.XXXXXX", pidfile[80];
+    char   **args;
+    int64_t *t, deadline;
+    pid_t    hogpid = 0, wpid = 0;
+    long     mb = 0;
+    int      n = 20, c, i, fd, got = 0, len;
+    FILE    *fp;
+
+    if( argc == 3 && strcmp( argv[1], "-c" ) == 0 ) stamp( argv[2] );
+
+    while( (c = getopt( argc, argv, "+n:m:")) != EOF )
+    {
+        switch( c )
+        {
+        case 'n': n  = atoi( optarg ); break;
+        case 'm': mb = atol( optarg ); break;
+        default:
+            fprintf( stderr, "usage : %s [ -n # ] [ -m MB ] watcher [ option ... ]\n", argv[0] );
+            exit( 6 );
+        }
+    }
+    if( optind >= argc || n < 1 )
+    {
+        fprintf( stderr, "usage : %s [ -n # ] [ -m MB ] watcher [ option ... ]\n", argv[0] );
+        exit( 6 );
+    }
+    len = readlink( "/proc/self/exe", self, sizeof( self ) -1 );
+    if( len < 0 || ( fd = mkstemp( stamps ) ) < 0 )
+    {
+        perror( "bench_restart" );
+        exit( 2 );
+    }
+    self[len] = '\0';
+    close( fd );
+    snprintf( pidfile, sizeof( pidfile ), "%s.pid", stamps );
+
+    // watcher [ option ... ] -t count.region -p pidfile -- self -c stamps
+    args = calloc( sizeof( char * ), argc - optind + 9 );
+    for( i = 0 ; optind + i < argc ; i ++ ) args[i] = argv[ optind + i ];
+    args[i++] = "-t";  args[i++] = "100000.1"; // never throttled
+    args[i++] = "-p";  args[i++] = pidfile;
+    args[i++] = "--";
+    args[i++] = self;  args[i++] = "-c";  args[i++] = stamps;
+
+    if( mb > 0 )
+    {
+        hogpid = hog( mb );
+        sleep( 2 ); // let it fill the memory.
+    }
+    if( fork() == 0 )
+    {
+        execv( args[0], args );
+        perror( args[0] );
+        exit( 9 );
+    }
+
+    deadline = now_ns() + (int64_t)( n + 10 ) * 3 * RESTART_DELAY;
+    t = calloc( sizeof( int64_t ), n + 1 );
+    while( got < n + 1 && now_ns() < deadline )
+    {
+        struct stat st;
+
+        usleep( 10000 );
+        if( stat( stamps, &st ) == 0 ) got = st.st_size / sizeof( int64_t );
+    }
+    if( ( fp = fopen( pidfile, "r" ) ) != NULL )
+    {
+        if( fscanf( fp, "%d", &wpid ) != 1 ) wpid = 0;
+        fclose( fp );
+    }
+    if( wpid > 0 )
+    {
+        printf( "watcher rss      %ld kB\n", rss_of( wpid ) );
+        kill( wpid, SIGTERM );
+    }
+    if( hogpid > 0 )
+    {
+        kill( hogpid, SIGKILL );
+        waitpid( hogpid, NULL, 0 );
+    }
+
+    fd = open( stamps, O_RDONLY );
+    if( got > n + 1 ) got = n + 1;
+    if( fd < 0 || got < 2 || read( fd, t, got * sizeof( int64_t ) ) != got * sizeof( int64_t ) )
+    {
+        fprintf( stderr, "too few restarts ( %d ).\n", got );
+        exit( 1 );
+    }
+    close( fd );
+    unlink( stamps );
+    unlink( pidfile );
+
+    for( i = 0 ; i < got -1 ; i ++ ) t[i] = t[i+1] - t[i] - RESTART_DELAY;
+    got --;
+    qsort( t, got, sizeof( int64_t ), cmp );
+    {
+        double sum = 0.0;
+
+        for( i = 0 ; i < got ; i ++ ) sum += t[i];
+        printf( "restarts         %d%s\n", got, ( mb > 0 ) ? " ( under pressure )" : "" );
+        printf( "latency msec     min %.3f avg %.3f p50 %.3f p99 %.3f max %.3f\n",
+                t[0] / 1e6, sum / got / 1e6, t[ got / 2 ] / 1e6,
+                t[ ( got * 99 ) / 100 ] / 1e6, t[ got -1 ] / 1e6 );
+    }
+    exit( 0 );
+}
@@ -0,0 +1,72 @@
+/*
+ * bench_twheel.c : microbenchmark of the timer wheel.
+ *
+ *  usage : bench_twheel [ timers ] [ max delay msec ]
+ *
+ *  insert, cancel ( half of them ) and expire ( the rest ) throughput.
+ *  the wheel is driven by a virtual clock, so only the data structure is
+ *  measured. expiry is also checked to be on the exact tick.
+ */
+#include "twheel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static long fired  = 0;
+static long wrong  = 0;
+
+static int64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void expire( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    fired ++;
+    if( t->expire != w->now - 1 ) wrong ++;
+}
+
+static void report( const char *name, long n, int64_t ns )
+{
+    printf( "%-8s %9ld ops %9.3f msec %8.2f Mops/s %7.1f nsec/op\n",
+            name, n, ns / 1e6, n / ( ns / 1e3 ), (double)ns / n );
+}
+
+int main( int argc, char *argv[] )
+{
+    struct twheel        w;
+    struct twheel_timer *timers;
+    long    n     = ( argc > 1 ) ? atol( argv[1] ) : 1000000;
+    long    range = ( argc > 2 ) ? atol( argv[2] ) : 3600000; /* 1hour */
+    long    i, cancelled = 0;
+    int64_t t0, clock;
+
+    timers = malloc( sizeof( struct twheel_timer ) * n );
+    if( timers == NULL || n <= 0 || range <= 0 ) return 1;
+
+    twheel_init( &w, TWHEEL_TICK, 0, 0 );
+    srandom( 1 );
+    for( i = 0 ; i < n ; i ++ ) twheel_timer_init( &timers[i], expire, NULL );
+
+    t0 = now_ns();
+    for( i = 0 ; i < n ; i ++ )
+        twheel_add( &w, &timers[i], ( 1 + random() % range ) * TWHEEL_TICK );
+    report( "insert", n, now_ns() - t0 );
+
+    t0 = now_ns();
+    for( i = 0 ; i < n ; i += 2, cancelled ++ )
+        twheel_cancel( &w, &timers[i] );
+    report( "cancel", cancelled, now_ns() - t0 );
+
+    t0 = now_ns();
+    for( clock = 0 ; w.pending > 0 ; clock += 10 * TWHEEL_TICK ) // 10msec step
+        twheel_advance( &w, clock );
+    report( "expire", fired, now_ns() - t0 );
+
+    printf( "fired %ld / %ld, off-tick %ld, virtual time %.1f sec\n",
+            fired, n - cancelled, wrong, clock / 1e9 );
+    return ( fired == n - cancelled && wrong == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/*
+ * crashtail.c : the last output of a child, kept for post-mortem ( -D ).
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "crashtail.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/*
+ * the ring, malloc()ed or mapped on dir/name.tail. NULL on error.
+ */
+struct crashtail *crashtail_open( const char *name, int size, const char *dir, int debug )
+{
+    struct crashtail *t;
+    size_t            len = sizeof( struct crashtail ) + size;
+    char              path[256];
+    struct stat       stbuf;
+    int               fd;
+
+    if( size <= 0 || size > CRASHTAIL_MAXSIZE )
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if( dir == NULL )
+    {
+        if( ( t = calloc( len, 1 ) ) == NULL ) return NULL;
+    }
+    else
+    {
+        snprintf( path, sizeof( path ), "%s/%s.tail", dir, name );
+        fd = open( path, O_RDWR | O_CREAT | O_CLOEXEC, 0600 );
+        if( fd < 0 ) return NULL;
+        if( fstat( fd, &stbuf ) < 0 || ( stbuf.st_size != (off_t)len && ftruncate( fd, len ) < 0 ) )
+        {
+            close( fd );
+            return NULL;
+        }
+        t = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+        if( t == MAP_FAILED ) return NULL;
+
+        // the child of a dead watcher, dump what it said.
+        if( t->magic == CRASHTAIL_MAGIC && t->size == (uint32_t)size && t->pid != 0 )
+        {
+            struct timespec ts;
+
+            clock_gettime( CLOCK_REALTIME, &ts );
+            t->wstatus = -1;
+            t->wall_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+            t->run_ns  = t->utime_us = t->stime_us = t->maxrss_kb = 0;
+            t->minflt  = t->majflt = t->nvcsw = t->nivcsw = 0;
+            crashtail_dump( t, debug );
+        }
+        memset( t, 0x00, sizeof( struct crashtail ) );
+        t->mapped = 1;
+        snprintf( t->crash, sizeof( t->crash ), "%s/%s.crash", dir, name );
+    }
+    t->magic = CRASHTAIL_MAGIC;
+    t->size  = size;
+    snprintf( t->name, sizeof( t->name ), "%s", name );
+    return t;
+}
+
+void crashtail_start( struct crashtail *t, pid_t pid )
+{
+    t->start   = __atomic_load_n( &( t->head ), __ATOMIC_ACQUIRE );
+    t->pending = 0;
+    t->dump    = 0;
+    t->pid     = pid;
+}
+
+/*
+ * by the log workers. stdout and stderr may be on different workers,
+ * each takes its room first.
+ */
+void crashtail_write( struct crashtail *t, const char *buff, int siz )
+{
+    uint64_t pos;
+    int      off, n;
+
+    if( siz > (int)t->size ) // only the last part fits.
+    {
+        buff += siz - t->size;
+        siz   = t->size;
+    }
+    pos = __atomic_fetch_add( &( t->head ), siz, __ATOMIC_ACQ_REL );
+    off = pos % t->size;
+    n   = ( off + siz <= (int)t->size ) ? siz : (int)t->size - off;
+    memcpy( t->data + off, buff, n );
+    if( n < siz ) memcpy( t->data, buff + n, siz - n );
+}
+
+/*
+ * the child terminated. dump now, or when npipes are drained.
+ *   dump : 0 if the termination is not a crash.
+ */
+void crashtail_exit( struct crashtail *t, int wstatus, int64_t run_ns,
+                     const struct rusage *ru, int npipes, int dump, int debug )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+    t->wstatus   = wstatus;
+    t->run_ns    = run_ns;
+    t->wall_ns   = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    t->utime_us  = ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+    t->stime_us  = ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+    t->maxrss_kb = ru->ru_maxrss;
+    t->minflt    = ru->ru_minflt;
+    t->majflt    = ru->ru_majflt;
+    t->nvcsw     = ru->ru_nvcsw;
+    t->nivcsw    = ru->ru_nivcsw;
+    t->dump      = dump;
+    __atomic_store_n( &( t->pending ), npipes, __ATOMIC_RELEASE );
+    if( npipes == 0 )
+    {
+        if( dump ) crashtail_dump( t, debug );
+        t->pid = 0;
+    }
+}
+
+/*
+ * a pipe of the terminated child is drained, by the log worker. the dump
+ * is due, the owner is told by the eventfd notify.
+ */
+void crashtail_drained( struct crashtail *t, int notify )
+{
+    uint64_t one = 1;
+
+    if( __atomic_sub_fetch( &( t->pending ), 1, __ATOMIC_ACQ_REL ) != 0 ) return ;
+
+    if( !t->dump )
+    {
+        t->pid = 0;
+        return ;
+    }
+    __atomic_store_n( &( t->dump ), 2, __ATOMIC_RELEASE );
+    write( notify, &one, sizeof( one ) );
+}
+
+/*
+ * by the owner : dump, if drained. 1 if dumped.
+ */
+int crashtail_due( struct crashtail *t, int debug )
+{
+    if( __atomic_load_n( &( t->dump ), __ATOMIC_ACQUIRE ) != 2 ) return 0;
+
+    crashtail_dump( t, debug );
+    t->dump = 0;
+    t->pid  = 0;
+    return 1;
+}
+
+/*
+ * private method: one line to syslog, or stderr.
+ */
+static void log_line( const struct crashtail *t, const char *line, int len, int debug )
+{
+    if( debug > 0 )
+        fprintf( stderr, "%s: %.*s\n", t->name, len, line );
+    else
+        syslog( LOG_ERR, "%s: %.*s", t->name, len, line );
+}
+
+/*
+ * write the status and the tail. -1 if the dump file can't be written.
+ */
+int crashtail_dump( struct crashtail *t, int debug )
+{
+    char      head[512], status[64], tbuff[64], line[CRASHTAIL_LINEMAX];
+    uint64_t  end = __atomic_load_n( &( t->head ), __ATOMIC_ACQUIRE ), from;
+    time_t    sec = t->wall_ns / 1000000000LL;
+    struct tm tm;
+    int       fd, off, n, len;
+
+    from = ( end - t->start > t->size ) ? end - t->size : t->start;
+
+    if( t->wstatus == -1 )
+        snprintf( status, sizeof( status ), "left by the previous watcher" );
+    else if( WIFSIGNALED( t->wstatus ) )
+        snprintf( status, sizeof( status ), "signal %d%s", WTERMSIG( t->wstatus ),
+                  WCOREDUMP( t->wstatus ) ? " (core)" : "" );
+    else
+        snprintf( status, sizeof( status ), "exit %d", WEXITSTATUS( t->wstatus ) );
+
+    strftime( tbuff, sizeof( tbuff ), "%Y-%m-%d %H:%M:%S", localtime_r( &sec, &tm ) );
+    snprintf( head, sizeof( head ), "%s [%d] %s at %s, run %.3f sec, user %.3f sec, sys %.3f sec,"
+              " maxrss %lld kB, faults %lld/%lld, ctxsw %lld/%lld, last %d bytes :",
+              t->name, t->pid, status, tbuff, t->run_ns / 1e9, t->utime_us / 1e6, t->stime_us / 1e6,
+              (long long)t->maxrss_kb, (long long)t->minflt, (long long)t->majflt,
+              (long long)t->nvcsw, (long long)t->nivcsw, (int)( end - from ) );
+
+    if( t->crash[0] != '\0' )
+    {
+        fd = open( t->crash, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600 );
+        if( fd < 0 ) return -1;
+
+        dprintf( fd, "%s\n", head );
+        off = from % t->size;
+        len = end - from;
+        n   = ( off + len <= (int)t->size ) ? len : (int)t->size - off;
+        if( write( fd, t->data + off, n ) != n || ( n < len && write( fd, t->data, len - n ) != len - n ) )
+        {
+            close( fd );
+            return -1;
+        }
+        if( len > 0 && t->data[ ( end - 1 ) % t->size ] != '\n' ) write( fd, "\n", 1 );
+        write( fd, "\n", 1 );
+        close( fd );
+        return 0;
+    }
+
+    log_line( t, head, strlen( head ), debug );
+    for( n = 0 ; from < end ; from ++ )
+    {
+        char c = t->data[ from % t->size ];
+
+        if( c != '\n' ) line[n++] = c;
+        if( c == '\n' || n == sizeof( line ) )
+        {
+            log_line( t, line, n, debug );
+            n = 0;
+        }
+    }
+    if( n > 0 ) log_line( t, line, n, debug );
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * crashtail.h : the last output of a child, kept for post-mortem ( -D ).
+ *
+ *  the log workers copy what they read from the child into a fixed ring,
+ *  nothing else on the steady path. when the child terminates abnormally
+ *  ( exit status != 0, or signaled ), the tail is dumped with the exit
+ *  status and the resource usage, once its pipes are drained. the log
+ *  workers only mark it due, the owner dumps it ( crashtail_due() ), so
+ *  the file or syslog is not written under the lock of the log pump.
+ *
+ *  the ring is in memory, or memory mapped on dir/name.tail to survive
+ *  a crash of watcher. then dumps go to dir/name.crash ( appended ),
+ *  else to syslog. the tail of a child left by a dead watcher is dumped
+ *  when the next one opens the file.
+ */
+#ifndef __WATCHER_CRASHTAIL_H__
+#define __WATCHER_CRASHTAIL_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define CRASHTAIL_MAGIC    0x31544357 /* "WCT1" */
+#define CRASHTAIL_MAXSIZE  ( 64 * 1024 * 1024 )
+#define CRASHTAIL_LINEMAX  1024       /* syslog record */
+
+struct crashtail {
+    uint32_t magic;
+    uint32_t size;        /* of data */
+    uint64_t head;        /* bytes ever written, the next is data[head % size] */
+    uint64_t start;       /* head at the start of the child */
+    int32_t  pid;         /* running child, 0 if none */
+    int32_t  pending;     /* pipes to drain before the dump */
+    int32_t  dump;        /* 1 : dump when drained, 2 : drained, due */
+    int32_t  wstatus;
+    int64_t  run_ns;
+    int64_t  wall_ns;     /* CLOCK_REALTIME at termination */
+    int64_t  utime_us, stime_us, maxrss_kb, minflt, majflt, nvcsw, nivcsw;
+    int32_t  mapped;
+    char     name[64];    /* progname[.index] */
+    char     crash[256];  /* dump file, empty for syslog */
+    char     data[1];
+};
+
+struct crashtail *crashtail_open( const char *name, int size, const char *dir, int debug );
+void crashtail_start( struct crashtail *t, pid_t pid );
+void crashtail_write( struct crashtail *t, const char *buff, int siz );
+void crashtail_exit( struct crashtail *t, int wstatus, int64_t run_ns,
+                     const struct rusage *ru, int npipes, int dump, int debug );
+void crashtail_drained( struct crashtail *t, int notify );
+int  crashtail_due( struct crashtail *t, int debug );
+int  crashtail_dump( struct crashtail *t, int debug );
+
+#endif /* __WATCHER_CRASHTAIL_H__ */
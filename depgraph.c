@@ -0,0 +1,360 @@
+/*
+ * depgraph.c : services with dependencies, started in dependency order.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "depgraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define SEPS  " \t\r\n"
+
+static int find( const struct depgraph *g, const char *name, int len )
+{
+    int i;
+
+    for( i = 0 ; i < g->n ; i ++ )
+    {
+        if( strncmp( g->svc[i].name, name, len ) == 0 && g->svc[i].name[len] == '\0' ) return i;
+    }
+    return -1;
+}
+
+/*
+ * "[addr:]port" -> addresses, numeric only. no name lookup on the main loop.
+ */
+static int tcp_addr( const char *spec, struct addrinfo **res )
+{
+    struct addrinfo  hints;
+    char             host[256] = "127.0.0.1";
+    const char      *port = strrchr( spec, ':' );
+
+    if( port == NULL )
+        port = spec;
+    else if( spec[0] == '[' && port > spec + 1 && port[-1] == ']' ) // [::1]:port
+    {
+        snprintf( host, sizeof( host ), "%.*s", (int)( port - spec - 2 ), spec + 1 );
+        port ++;
+    }
+    else
+    {
+        snprintf( host, sizeof( host ), "%.*s", (int)( port - spec ), spec );
+        port ++;
+    }
+    memset( &hints, 0x00, sizeof( hints ) );
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_NUMERICHOST | AI_NUMERICSERV;
+    return getaddrinfo( host, port, &hints, res ) == 0 ? 0 : -1;
+}
+
+static int valid_ready( const char *spec )
+{
+    struct addrinfo *res;
+
+    if( strncmp( spec, "tcp:", 4 ) == 0 )
+    {
+        if( tcp_addr( spec + 4, &res ) < 0 ) return 0;
+        freeaddrinfo( res );
+        return 1;
+    }
+    return strcmp( spec, "start" ) == 0
+        || ( strncmp( spec, "delay:", 6 ) == 0 && atoi( spec + 6 ) >= 0 )
+        || ( strncmp( spec, "file:",  5 ) == 0 && spec[5] != '\0' );
+}
+
+/*
+ * private method: "after=" names -> indexes, after all lines are read.
+ */
+static int resolve( struct depgraph *g, char **after, char *err, int errlen )
+{
+    int   i, j;
+    char *p, *q;
+
+    for( i = 0 ; i < g->n ; i ++ )
+    {
+        struct depservice *s = &( g->svc[i] );
+
+        if( after[i] == NULL ) continue;
+        s->deps = calloc( sizeof( int ), (unsigned int)g->n );
+        if( s->deps == NULL ) return -1;
+
+        for( p = after[i] ; *p != '\0' ; p = ( *q == ',' ) ? q+1 : q )
+        {
+            q = strchr( p, ',' );
+            if( q == NULL ) q = p + strlen( p );
+            if( q == p ) continue;
+
+            j = find( g, p, q - p );
+            if( j < 0 || j == i )
+            {
+                snprintf( err, errlen, "service '%s' : unknown dependency '%.*s'.", s->name, (int)( q - p ), p );
+                return -1;
+            }
+            s->deps[ s->ndeps ++ ] = j;
+        }
+    }
+    return 0;
+}
+
+/*
+ * private method: a cycle can never be started. Kahn's algorithm.
+ */
+static int acyclic( const struct depgraph *g, char *err, int errlen )
+{
+    int *left = calloc( sizeof( int ), (unsigned int)g->n ), *done = calloc( sizeof( int ), (unsigned int)g->n );
+    int  i, k, progress, ret = 0;
+
+    if( left == NULL || done == NULL ) return -1;
+    for( i = 0 ; i < g->n ; i ++ ) left[i] = g->svc[i].ndeps;
+
+    do{
+        progress = 0;
+        for( i = 0 ; i < g->n ; i ++ )
+        {
+            if( done[i] || left[i] > 0 ) continue;
+            done[i] = progress = 1;
+            for( k = 0 ; k < g->n ; k ++ ) // dependents of i
+            {
+                int d;
+
+                for( d = 0 ; d < g->svc[k].ndeps ; d ++ )
+                {
+                    if( g->svc[k].deps[d] == i ) left[k] --;
+                }
+            }
+        }
+    }while( progress );
+
+    for( i = 0 ; i < g->n ; i ++ )
+    {
+        if( !done[i] )
+        {
+            snprintf( err, errlen, "service '%s' : dependency cycle.", g->svc[i].name );
+            ret = -1;
+            break;
+        }
+    }
+    free( left );
+    free( done );
+    return ret;
+}
+
+/*
+ * read the config file. NULL on error, with the reason in err.
+ */
+struct depgraph *depgraph_load( const char *path, char *err, int errlen )
+{
+    struct depgraph *g;
+    char            *after[DEP_MAXSERVICES];
+    char             line[4096], *tok, *p;
+    int              lineno = 0, i;
+    FILE            *fp;
+
+    fp = fopen( path, "r" );
+    if( fp == NULL )
+    {
+        snprintf( err, errlen, "can't open '%s', %s", path, strerror( errno ) );
+        return NULL;
+    }
+    g = calloc( sizeof( struct depgraph ) + sizeof( struct depservice ) * DEP_MAXSERVICES, 1 );
+    if( g == NULL ) return NULL;
+
+#define BROKEN( ... ) do{ snprintf( err, errlen, __VA_ARGS__ ); fclose( fp ); return NULL; }while(0)
+
+    while( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+        struct depservice *s = &( g->svc[ g->n ] );
+
+        lineno ++;
+        if( ( p = strchr( line, '#' ) ) != NULL ) *p = '\0';
+        if( ( tok = strtok( line, SEPS ) ) == NULL ) continue; // empty
+
+        if( g->n >= DEP_MAXSERVICES ) BROKEN( "%s:%d : too many services.", path, lineno );
+        if( find( g, tok, strlen( tok ) ) >= 0 ) BROKEN( "%s:%d : service '%s' again.", path, lineno, tok );
+
+        s->name  = strdup( tok );
+        s->ready = "start";
+        s->gate  = -1;
+        s->probefd = -1;
+        after[ g->n ] = NULL;
+        s->argv  = calloc( sizeof( char * ), DEP_MAXARGS + 1 );
+        while( ( tok = strtok( NULL, SEPS ) ) != NULL )
+        {
+            if( s->argc == 0 && strncmp( tok, "after=", 6 ) == 0 )
+                after[ g->n ] = strdup( tok + 6 );
+            else if( s->argc == 0 && strncmp( tok, "ready=", 6 ) == 0 )
+            {
+                if( !valid_ready( tok + 6 ) ) BROKEN( "%s:%d : broken '%s'.", path, lineno, tok );
+                s->ready = strdup( tok + 6 );
+            }
+            else if( s->argc == 0 && strcmp( tok, "critical" ) == 0 )
+                s->critical = 1;
+            else if( s->argc < DEP_MAXARGS )
+                s->argv[ s->argc ++ ] = strdup( tok );
+            else
+                BROKEN( "%s:%d : too many arguments.", path, lineno );
+        }
+        if( s->argc == 0 ) BROKEN( "%s:%d : service '%s' has no command.", path, lineno, s->name );
+        if( access( s->argv[0], X_OK ) < 0 )
+            BROKEN( "%s:%d : command '%s' not exist.", path, lineno, s->argv[0] );
+        g->n ++;
+    }
+    fclose( fp );
+#undef BROKEN
+
+    if( g->n == 0 )
+    {
+        snprintf( err, errlen, "%s : no service.", path );
+        return NULL;
+    }
+    if( resolve( g, after, err, errlen ) < 0 || acyclic( g, err, errlen ) < 0 ) return NULL;
+    for( i = 0 ; i < g->n ; i ++ ) free( after[i] );
+    return g;
+}
+
+/*
+ * a service to start now, -1 if none ( waiting for dependencies, or limit ).
+ */
+int depgraph_next( struct depgraph *g )
+{
+    int i, d;
+
+    if( g->limit > 0 && g->starting >= g->limit ) return -1;
+
+    for( i = 0 ; i < g->n ; i ++ )
+    {
+        struct depservice *s = &( g->svc[i] );
+
+        if( s->status != DEP_WAITING ) continue;
+        for( d = 0 ; d < s->ndeps ; d ++ )
+        {
+            if( g->svc[ s->deps[d] ].status != DEP_READY ) break;
+        }
+        if( d == s->ndeps ) return i;
+    }
+    return -1;
+}
+
+void depgraph_started( struct depgraph *g, int i, int64_t now )
+{
+    struct depservice *s = &( g->svc[i] );
+    int d;
+
+    if( g->begin == 0 ) g->begin = now;
+    s->status  = DEP_STARTING;
+    s->started = now;
+    s->gate    = -1;
+    for( d = 0 ; d < s->ndeps ; d ++ ) // which one held it back.
+    {
+        if( s->gate < 0 || g->svc[ s->deps[d] ].readyat > g->svc[ s->gate ].readyat )
+            s->gate = s->deps[d];
+    }
+    g->starting ++;
+}
+
+void depgraph_ready( struct depgraph *g, int i, int64_t now )
+{
+    if( g->svc[i].probefd >= 0 ) close( g->svc[i].probefd );
+    g->svc[i].probefd = -1;
+    g->svc[i].status  = DEP_READY;
+    g->svc[i].readyat = now;
+    g->starting --;
+    g->ready ++;
+}
+
+/*
+ * private method: the port accepts a connection ? on the main loop, so
+ * nothing waits. the connect goes on in s->probefd, and is checked by
+ * the next probe. not yet is not ready.
+ */
+static int tcp_ready( struct depservice *s, const char *spec )
+{
+    struct addrinfo *res, *ai;
+    struct pollfd    pfd;
+    socklen_t        len = sizeof( int );
+    int              fd, err = 0, ok = 0;
+
+    if( s->probefd >= 0 ) // connecting since the last probe.
+    {
+        pfd.fd     = s->probefd;
+        pfd.events = POLLOUT;
+        if( poll( &pfd, 1, 0 ) == 0 ) return 0;
+
+        ok = ( getsockopt( s->probefd, SOL_SOCKET, SO_ERROR, &err, &len ) == 0 && err == 0 );
+        close( s->probefd );
+        s->probefd = -1;
+        return ok;
+    }
+    if( tcp_addr( spec, &res ) < 0 ) return 0;
+
+    for( ai = res ; ai != NULL ; ai = ai->ai_next )
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol );
+        if( fd < 0 ) continue;
+        if( connect( fd, ai->ai_addr, ai->ai_addrlen ) == 0 )
+            ok = 1;
+        else if( errno == EINPROGRESS )
+        {
+            s->probefd = fd;
+            break;
+        }
+        close( fd );
+        if( ok ) break;
+    }
+    freeaddrinfo( res );
+    return ok;
+}
+
+/*
+ * 1 if the service is ready. since : start of the running process.
+ */
+int depgraph_probe( struct depservice *s, int64_t since, int64_t now )
+{
+    if( strncmp( s->ready, "delay:", 6 ) == 0 )
+        return now - since >= atoi( s->ready + 6 ) * 1000000LL;
+    if( strncmp( s->ready, "file:", 5 ) == 0 )
+        return access( s->ready + 5, F_OK ) == 0;
+    if( strncmp( s->ready, "tcp:", 4 ) == 0 )
+        return tcp_ready( s, s->ready + 4 );
+    return 1; // start
+}
+
+/*
+ * the chain of services which decided the startup time, last first.
+ * "name started-ready ( waited # ) <- ...", seconds from the first start.
+ */
+int depgraph_critical( const struct depgraph *g, char *buff, int len )
+{
+    int i, last = -1, n = 0;
+
+    for( i = 0 ; i < g->n ; i ++ )
+    {
+        if( g->svc[i].status == DEP_READY && ( last < 0 || g->svc[i].readyat > g->svc[last].readyat ) )
+            last = i;
+    }
+    buff[0] = '\0';
+    for( i = last ; i >= 0 && n < len ; i = g->svc[i].gate )
+    {
+        const struct depservice *s = &( g->svc[i] );
+        // started later than the gate was ready : held by the limit.
+        int64_t wait = s->started - ( ( s->gate >= 0 ) ? g->svc[ s->gate ].readyat : g->begin );
+
+        n += snprintf( buff + n, len - n, "%s%s %.3f-%.3f", ( i == last ) ? "" : " <- ", s->name,
+                       ( s->started - g->begin ) / 1e9, ( s->readyat - g->begin ) / 1e9 );
+        if( wait > 0 && n < len ) n += snprintf( buff + n, len - n, " ( waited %.3f )", wait / 1e9 );
+    }
+    return ( last < 0 ) ? 0 : (int)( ( g->svc[last].readyat - g->begin ) / 1000000 );
+}
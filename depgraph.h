@@ -0,0 +1,68 @@
+/*
+ * depgraph.h : services with dependencies, started in dependency order.
+ *
+ *  config file ( -C ), one service per line, no quoting:
+ *
+ *    name [ after=dep,... ] [ ready=spec ] [ critical ] command [ args ... ]
+ *
+ *  a service is started when all services in after= are ready, as many
+ *  in parallel as the limit ( -P ) allows. ready=spec tells when it is
+ *  ready for its dependents:
+ *
+ *    start            : when started. ( default )
+ *    delay:#          : # msec after started.
+ *    file:path        : path exists.
+ *    tcp:[addr:]port  : port accepts connections. ( numeric local addresses,
+ *                       [addr] for IPv6 )
+ *
+ *  "critical" before the command marks a service restarted even under
+ *  pressure ( -Q ).
+ *
+ *  '#' to the end of line is a comment.
+ */
+#ifndef __WATCHER_DEPGRAPH_H__
+#define __WATCHER_DEPGRAPH_H__
+
+#include <stdint.h>
+
+#define DEP_MAXSERVICES 256
+#define DEP_MAXARGS     64
+
+/* status */
+#define DEP_WAITING     0
+#define DEP_STARTING    1   /* started, not ready yet */
+#define DEP_READY       2
+
+struct depservice {
+    char     *name;
+    char     *ready;        /* spec */
+    int       critical;
+    int       ndeps;
+    int      *deps;         /* indexes */
+    int       argc;
+    char    **argv;
+    int       status;
+    int64_t   started;      /* first start, CLOCK_MONOTONIC nsec */
+    int64_t   readyat;
+    int       gate;         /* the dependency ready last, -1 if none */
+    int       probefd;      /* tcp probe connecting, -1 if none */
+};
+
+struct depgraph {
+    int       n;
+    int       limit;        /* starting at once, 0 is unlimited */
+    int       starting;
+    int       ready;
+    int64_t   begin;        /* the first start */
+    struct depservice svc[1];
+};
+
+struct depgraph *depgraph_load( const char *path, char *err, int errlen );
+int  depgraph_next( struct depgraph *g );
+void depgraph_started( struct depgraph *g, int i, int64_t now );
+void depgraph_ready( struct depgraph *g, int i, int64_t now );
+#define depgraph_done( G )  ( ( G )->ready == ( G )->n )
+int  depgraph_probe( struct depservice *s, int64_t since, int64_t now );
+int  depgraph_critical( const struct depgraph *g, char *buff, int len );
+
+#endif /* __WATCHER_DEPGRAPH_H__ */
@@ -0,0 +1,122 @@
+/*
+ * harden.c : keep watcher alive under memory pressure ( -M ).
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "harden.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+#define OOMADJ_PATH  "/proc/self/oom_score_adj"
+
+/*
+ * private method: fault in the stack, not to fault later under pressure.
+ */
+static void prefault_stack( void )
+{
+    volatile char stack[HARDEN_STACK];
+
+    memset( (char *)stack, 0x00, sizeof( stack ) );
+}
+
+/*
+ * grow the heap once, and keep it. later malloc() of libc ( syslog,
+ * strerror ... ) is served from it, without asking the kernel.
+ */
+int harden_heap( size_t size )
+{
+    char *p;
+
+    mallopt( M_TRIM_THRESHOLD, -1 ); // never give back
+    mallopt( M_MMAP_MAX, 0 );        // no mmap() per large block
+    p = malloc( size );
+    if( p == NULL ) return -1;
+
+    memset( p, 0x00, size );
+    free( p );
+    prefault_stack();
+    return 0;
+}
+
+/*
+ * lock all memory, now and later ( thread stacks, the journal ... ).
+ */
+int harden_lock( void )
+{
+    return mlockall( MCL_CURRENT | MCL_FUTURE );
+}
+
+/*
+ * set oom_score_adj of watcher, and save the original one in saved
+ * ( as written to the file, for the child ).
+ */
+int harden_oomadj( int adj, char *saved, int len )
+{
+    char buff[32];
+    int  fd, siz;
+
+    fd = open( OOMADJ_PATH, O_RDWR | O_CLOEXEC );
+    if( fd < 0 ) return -1;
+
+    siz = read( fd, saved, len -1 );
+    saved[ ( siz > 0 ) ? siz : 0 ] = '\0';
+
+    siz = snprintf( buff, sizeof( buff ), "%d\n", adj );
+    if( lseek( fd, 0, SEEK_SET ) < 0 || write( fd, buff, siz ) != siz )
+    {
+        close( fd );
+        return -1;
+    }
+    close( fd );
+    return 0;
+}
+
+/*
+ * in the child after fork(), async-signal-safe.
+ */
+int harden_restore_oomadj( const char *saved )
+{
+    int fd, ret;
+
+    if( saved[0] == '\0' ) return 0;
+
+    fd = open( OOMADJ_PATH, O_WRONLY );
+    if( fd < 0 ) return -1;
+
+    ret = write( fd, saved, strlen( saved ) );
+    close( fd );
+    return ( ret < 0 ) ? -1 : 0;
+}
+
+/*
+ * resident size in kB, and locked size in *locked. -1 if unknown.
+ */
+long harden_rss( long *locked )
+{
+    FILE *fp;
+    char  line[128];
+    long  rss = -1;
+
+    if( locked != NULL ) *locked = -1;
+    fp = fopen( "/proc/self/status", "r" );
+    if( fp == NULL ) return -1;
+
+    while( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+        if( strncmp( line, "VmRSS:", 6 ) == 0 ) rss = atol( line + 6 );
+        else if( strncmp( line, "VmLck:", 6 ) == 0 && locked != NULL ) *locked = atol( line + 6 );
+    }
+    fclose( fp );
+    return rss;
+}
@@ -0,0 +1,24 @@
+/*
+ * harden.h : keep watcher alive under memory pressure ( -M ).
+ *
+ *  everything the restart and logging paths need is allocated at start,
+ *  the heap is grown once and never trimmed, all memory is locked, and
+ *  watcher is the last candidate of the OOM killer. the children get the
+ *  original oom_score_adj back.
+ */
+#ifndef __WATCHER_HARDEN_H__
+#define __WATCHER_HARDEN_H__
+
+#include <stddef.h>
+
+#define HARDEN_HEAP   ( 1024 * 1024 )     /* heap kept for malloc() of libc */
+#define HARDEN_STACK  ( 256 * 1024 )      /* stack of the main thread */
+#define HARDEN_OOMADJ -1000
+
+int  harden_heap( size_t size );
+int  harden_lock( void );
+int  harden_oomadj( int adj, char *saved, int len );
+int  harden_restore_oomadj( const char *saved );
+long harden_rss( long *locked );
+
+#endif /* __WATCHER_HARDEN_H__ */
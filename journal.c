@@ -0,0 +1,205 @@
+/*
+ * journal.c : persistent lifecycle journal for watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int64_t journal_now( int clockid )
+{
+    struct timespec ts;
+
+    clock_gettime( clockid, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void read_bootid( char *buff, size_t len )
+{
+    int fd, siz;
+
+    memset( buff, 0x00, len );
+    fd = open( "/proc/sys/kernel/random/boot_id", O_RDONLY );
+    if( fd < 0 ) return ; // not linux, leave empty.
+
+    siz = read( fd, buff, len -1 );
+    if( siz > 0 && buff[siz-1] == '\n' ) buff[siz-1] = '\0';
+    close( fd );
+}
+
+/*
+ * open (and create, if writable) the journal file. writable is locked
+ * until journal_close().
+ *   slots : ring length for new file. ignored if file already exist.
+ */
+struct journal *journal_open( const char *path, int slots, int writable )
+{
+    struct journal      *j;
+    struct journal_head  head;
+    struct stat          stbuf;
+    size_t               len;
+    int                  fd;
+
+    if( slots <= 0 ) slots = JOURNAL_SLOTS;
+
+    fd = open( path, ( writable ? ( O_RDWR | O_CREAT ) : O_RDONLY ) | O_CLOEXEC, 0644 );
+    if( fd < 0 ) return NULL;
+
+    // one writer, another watcher on the same file is refused ( EWOULDBLOCK ).
+    if( writable && flock( fd, LOCK_EX | LOCK_NB ) < 0 ) goto error;
+
+    if( fstat( fd, &stbuf ) < 0 ) goto error;
+
+    if( stbuf.st_size == 0 && writable ) // new file, preallocate.
+    {
+        memset( &head, 0x00, sizeof( head ) );
+        head.magic   = JOURNAL_MAGIC;
+        head.version = JOURNAL_VERSION;
+        head.recsize = sizeof( struct journal_rec );
+        head.slots   = slots;
+
+        len = JOURNAL_HEADSIZE + (size_t)slots * sizeof( struct journal_rec );
+        if( ftruncate( fd, len ) < 0 ) goto error;
+        if( posix_fallocate( fd, 0, len ) != 0 ) goto error;
+        if( pwrite( fd, &head, sizeof( head ), 0 ) != sizeof( head ) ) goto error;
+    }
+    else
+    {
+        if( pread( fd, &head, sizeof( head ), 0 ) != sizeof( head ) ) goto error;
+    }
+
+    if( head.magic   != JOURNAL_MAGIC
+     || head.version != JOURNAL_VERSION
+     || head.recsize != sizeof( struct journal_rec )
+     || head.slots   == 0 )
+    {
+        errno = EINVAL;
+        goto error;
+    }
+    len = JOURNAL_HEADSIZE + (size_t)head.slots * sizeof( struct journal_rec );
+    if( fstat( fd, &stbuf ) < 0 ) goto error;
+    if( (size_t)stbuf.st_size < len )
+    {
+        errno = EINVAL;
+        goto error;
+    }
+
+    j = calloc( sizeof( struct journal ), 1 );
+    if( j == NULL ) goto error;
+
+    j->fd       = fd;
+    j->writable = writable;
+    j->maplen   = len;
+    j->head     = mmap( NULL, len, writable ? ( PROT_READ | PROT_WRITE ) : PROT_READ,
+                        MAP_SHARED, fd, 0 );
+    if( j->head == MAP_FAILED )
+    {
+        free( j );
+        goto error;
+    }
+    j->recs = (struct journal_rec *)( (char *)j->head + JOURNAL_HEADSIZE );
+
+    if( writable )
+    {
+        char bootid[ sizeof( j->head->boot_id ) ];
+
+        read_bootid( bootid, sizeof( bootid ) );
+        if( strcmp( bootid, j->head->boot_id ) != 0 )
+        {
+            // records of the previous boot have useless monotonic time.
+            memcpy( j->head->boot_id, bootid, sizeof( bootid ) );
+            j->head->bootfirst = j->head->count;
+        }
+        j->head->generation ++;
+        msync( j->head, JOURNAL_HEADSIZE, MS_ASYNC );
+    }
+    return j;
+
+error:
+    {
+        int e = errno;
+        close( fd );
+        errno = e;
+    }
+    return NULL;
+}
+
+void journal_sync( struct journal *j )
+{
+    if( j == NULL || !j->writable ) return ;
+
+    msync( j->head, j->maplen, MS_ASYNC );
+    j->unsynced = 0;
+}
+
+void journal_close( struct journal *j )
+{
+    if( j == NULL ) return ;
+
+    if( j->writable && j->unsynced > 0 )
+        msync( j->head, j->maplen, MS_SYNC );
+    munmap( j->head, j->maplen );
+    close( j->fd );
+    free( j );
+}
+
+/*
+ * append one record. only memcpy, msync is deferred.
+ */
+int journal_append( struct journal *j, const struct journal_rec *rec )
+{
+    uint64_t cnt;
+
+    if( j == NULL || !j->writable ) return -1;
+
+    cnt = j->head->count;
+    memcpy( &( j->recs[ cnt % j->head->slots ] ), rec, sizeof( *rec ) );
+    j->head->count = cnt + 1; // publish after copy.
+
+    if( ++( j->unsynced ) >= JOURNAL_SYNCEVERY ) journal_sync( j );
+    return 0;
+}
+
+int journal_length( const struct journal *j )
+{
+    if( j == NULL ) return 0;
+
+    return ( j->head->count < j->head->slots ) ? (int)j->head->count
+                                               : (int)j->head->slots ;
+}
+
+const struct journal_rec *journal_get( const struct journal *j, int prev )
+{
+    if( j == NULL || prev < 0 || prev >= journal_length( j ) ) return NULL;
+
+    return &( j->recs[ ( j->head->count - 1 - prev ) % j->head->slots ] );
+}
+
+/*
+ * the monotonic timestamp of the record is comparable with ours ?
+ */
+int journal_sameboot( const struct journal *j, int prev )
+{
+    char bootid[ sizeof( j->head->boot_id ) ];
+
+    if( journal_get( j, prev ) == NULL ) return 0;
+
+    read_bootid( bootid, sizeof( bootid ) );
+    if( bootid[0] == '\0' || strcmp( bootid, j->head->boot_id ) != 0 ) return 0;
+
+    return j->head->count - 1 - prev >= j->head->bootfirst ;
+}
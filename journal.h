@@ -0,0 +1,73 @@
+/*
+ * journal.h : persistent lifecycle journal for watcher.
+ *
+ *  fixed size records in a preallocated, memory mapped ring file.
+ *  one file per watched service.
+ *
+ *  file layout :
+ *     +--------------------+  0
+ *     | journal_head       |
+ *     +--------------------+  JOURNAL_HEADSIZE
+ *     | journal_rec [0]    |
+ *     | journal_rec [1]    |
+ *     |  ...               |
+ *     | journal_rec [n-1]  |
+ *     +--------------------+
+ */
+#ifndef __WATCHER_JOURNAL_H__
+#define __WATCHER_JOURNAL_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define JOURNAL_MAGIC      0x314a5457 /* "WTJ1" */
+#define JOURNAL_VERSION    1
+#define JOURNAL_HEADSIZE   128
+#define JOURNAL_SLOTS      1024       /* default ring length */
+#define JOURNAL_SYNCEVERY  16         /* msync each # records */
+
+struct journal_head {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recsize;
+    uint32_t slots;
+    uint64_t count;       /* records ever written, next slot is count % slots */
+    uint32_t generation;  /* incremented on each watcher start */
+    uint32_t reserved;
+    uint64_t bootfirst;   /* first record written in this boot */
+    char     boot_id[40]; /* monotonic time is valid only in same boot */
+};
+
+struct journal_rec {
+    int64_t  mono_ns;     /* CLOCK_MONOTONIC at termination */
+    int64_t  wall_ns;     /* CLOCK_REALTIME  at termination */
+    int64_t  run_ns;      /* run duration of the child */
+    int32_t  pid;
+    uint32_t generation;  /* watcher generation */
+    int32_t  wstatus;     /* raw status of wait(2) */
+    int32_t  instance;    /* instance index in pool mode */
+};
+
+struct journal {
+    int                  fd;
+    int                  writable;
+    int                  unsynced;
+    size_t               maplen;
+    struct journal_head *head;
+    struct journal_rec  *recs;
+};
+
+struct journal *journal_open( const char *path, int slots, int writable );
+void journal_close( struct journal *j );
+
+int  journal_append( struct journal *j, const struct journal_rec *rec );
+void journal_sync( struct journal *j );
+
+/* prev = 0 is the newest record. NULL if not exist. */
+const struct journal_rec *journal_get( const struct journal *j, int prev );
+int  journal_length( const struct journal *j );
+int  journal_sameboot( const struct journal *j, int prev );
+
+int64_t journal_now( int clockid );
+
+#endif /* __WATCHER_JOURNAL_H__ */
@@ -0,0 +1,185 @@
+/*
+ * listener.c : listening socket held by watcher, shared with the children.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "listener.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/*
+ * "[addr:]port" -> listening TCP socket, -1 on error.
+ *   SO_REUSEPORT lets another watcher ( e.g. the new one on upgrade ) bind
+ *   the same port while this one is still serving.
+ */
+int listener_open( const char *spec, int backlog )
+{
+    struct addrinfo  hints, *res, *ai;
+    char             buff[256];
+    char            *host = buff, *port;
+    int              fd = -1, on = 1, e = 0;
+
+    if( strlen( spec ) >= sizeof( buff ) )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    strcpy( buff, spec );
+
+    port = strrchr( host, ':' );
+    if( port == NULL )
+    {
+        port = host;
+        host = NULL;
+    }else{
+       *port++ = '\0';
+        if( host[0] == '\0' || strcmp( host, "*" ) == 0 ) host = NULL;
+        else if( host[0] == '[' ) // [::1]
+        {
+            host ++;
+            if( host[ strlen( host ) -1 ] == ']' ) host[ strlen( host ) -1 ] = '\0';
+        }
+    }
+
+    memset( &hints, 0x00, sizeof( hints ) );
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    if( getaddrinfo( host, port, &hints, &res ) != 0 )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for( ai = res ; ai != NULL ; ai = ai->ai_next )
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol );
+        if( fd < 0 ) continue;
+
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+        setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof( on ) );
+        if( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0
+         && listen( fd, backlog ) == 0 ) break;
+
+        e = errno;
+        close( fd );
+        fd = -1;
+    }
+    freeaddrinfo( res );
+    if( fd < 0 && e != 0 ) errno = e;
+    return fd;
+}
+
+/*
+ * in the child : move the listener to LISTENER_FD, inheritable.
+ */
+int listener_pass( int fd )
+{
+    if( fd != LISTENER_FD )
+    {
+        if( dup2( fd, LISTENER_FD ) < 0 ) return -1;
+        return 0; // dup2() clears FD_CLOEXEC
+    }
+    return fcntl( fd, F_SETFD, 0 );
+}
+
+/*
+ * a connection is waiting in the accept queue ?
+ */
+int listener_pending( int fd )
+{
+    struct pollfd pfd;
+
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    return poll( &pfd, 1, 0 ) > 0 && ( pfd.revents & POLLIN );
+}
+
+/*
+ * "0100007F" of /proc/net/tcp{,6} -> bytes of the address. returns the length.
+ *   the kernel prints each 32 bit word of it in host order.
+ */
+static int parse_addr( const char *hex, unsigned char *addr )
+{
+    unsigned int w;
+    char         word[9];
+    int          i, len = strlen( hex ) / 8;
+
+    if( len != 1 && len != 4 ) return -1;
+    for( i = 0 ; i < len ; i ++ )
+    {
+        memcpy( word, hex + i * 8, 8 );
+        word[8] = '\0';
+        if( sscanf( word, "%x", &w ) != 1 ) return -1;
+        memcpy( addr + i * 4, &w, 4 );
+    }
+    return len * 4;
+}
+
+/*
+ * ESTABLISHED connections on addr:port, any address if addr is NULL.
+ */
+static int count_conns( const char *path, const unsigned char *addr, int alen, int port )
+{
+    FILE *fp;
+    char  line[512], hex[40];
+    unsigned char local[16];
+    unsigned int  lport, st;
+    int   n = 0;
+
+    fp = fopen( path, "r" );
+    if( fp == NULL ) return 0;
+
+    fgets( line, sizeof( line ), fp ); // header
+    while( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+        // "  sl  local_address rem_address   st ..."
+        if( sscanf( line, "%*d: %32[0-9A-Fa-f]:%x %*[0-9A-Fa-f]:%*x %x", hex, &lport, &st ) != 3 )
+            continue;
+        if( lport != (unsigned int)port || st != 0x01 /* ESTABLISHED */ ) continue;
+        if( addr != NULL
+         && ( parse_addr( hex, local ) != alen || memcmp( local, addr, alen ) != 0 ) ) continue;
+        n ++;
+    }
+    fclose( fp );
+    return n;
+}
+
+/*
+ * connections to the listener ( accepted by the children ).
+ */
+int listener_connections( int fd )
+{
+    struct sockaddr_storage ss;
+    struct sockaddr_in     *sin  = (struct sockaddr_in *)&ss;
+    struct sockaddr_in6    *sin6 = (struct sockaddr_in6 *)&ss;
+    socklen_t len = sizeof( ss );
+
+    if( getsockname( fd, (struct sockaddr *)&ss, &len ) < 0 ) return -1;
+
+    // a wildcard listener takes the connections to any local address.
+    if( ss.ss_family == AF_INET )
+        return count_conns( "/proc/net/tcp",
+                            ( sin->sin_addr.s_addr == htonl( INADDR_ANY ) ) ? NULL
+                                : (unsigned char *)&( sin->sin_addr ), 4, ntohs( sin->sin_port ) );
+    if( ss.ss_family == AF_INET6 )
+        return count_conns( "/proc/net/tcp6",
+                            IN6_IS_ADDR_UNSPECIFIED( &( sin6->sin6_addr ) ) ? NULL
+                                : (unsigned char *)&( sin6->sin6_addr ), 16, ntohs( sin6->sin6_port ) );
+    return -1;
+}
@@ -0,0 +1,18 @@
+/*
+ * listener.h : listening socket held by watcher, shared with the children.
+ *
+ *  the socket is passed as fd LISTENER_FD with the systemd style
+ *  environment ( LISTEN_FDS=1, LISTEN_PID=pid ).
+ */
+#ifndef __WATCHER_LISTENER_H__
+#define __WATCHER_LISTENER_H__
+
+#define LISTENER_FD      3
+#define LISTENER_BACKLOG 1024
+
+int listener_open( const char *spec, int backlog );
+int listener_pass( int fd );
+int listener_pending( int fd );
+int listener_connections( int fd );
+
+#endif /* __WATCHER_LISTENER_H__ */
@@ -0,0 +1,319 @@
+/*
+ * logfwd.c : forward the output of the children to syslog / journald.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#define _GNU_SOURCE
+#define SYSLOG_NAMES
+#include "logfwd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SYSLOG_PATH   "/dev/log"
+#define JOURNAL_PATH  "/run/systemd/journal/socket"
+#define RETRY         1000000000LL /* reconnect interval, nsec */
+
+static int64_t monotonic_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * private method: connect to the log daemon. blocking, the sender
+ * thread may wait but nobody else does.
+ */
+static int fwd_connect( struct logfwd *fw )
+{
+    struct sockaddr_un sun;
+
+    memset( &sun, 0x00, sizeof( sun ) );
+    sun.sun_family = AF_UNIX;
+    strcpy( sun.sun_path, ( fw->mode == LOGFWD_JOURNAL ) ? JOURNAL_PATH : SYSLOG_PATH );
+
+    fw->fd = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    if( fw->fd >= 0 && connect( fw->fd, (struct sockaddr *)&sun, sizeof( sun ) ) == 0 )
+        return 0;
+
+    if( fw->fd >= 0 ) close( fw->fd );
+    fw->fd    = -1;
+    fw->retry = monotonic_now() + RETRY;
+    return -1;
+}
+
+/*
+ * private method: send n lines from the head. the slots are not reused
+ * until the head moves, so no lock while sending.
+ */
+static void fwd_send( struct logfwd *fw, int head, int n )
+{
+    struct mmsghdr msgs[LOGFWD_BATCH];
+    struct iovec   iovs[LOGFWD_BATCH];
+    int            i, ret, done = 0;
+
+    if( fw->fd < 0 && ( monotonic_now() < fw->retry || fwd_connect( fw ) < 0 ) )
+    {
+        pthread_mutex_lock( &( fw->lock ) );
+        fw->dropped += n;
+        pthread_mutex_unlock( &( fw->lock ) );
+        return ;
+    }
+
+    memset( msgs, 0x00, sizeof( struct mmsghdr ) * n );
+    for( i = 0 ; i < n ; i ++ )
+    {
+        iovs[i].iov_base           = fw->ring[head + i].buff;
+        iovs[i].iov_len            = fw->ring[head + i].len;
+        msgs[i].msg_hdr.msg_iov    = &( iovs[i] );
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while( done < n )
+    {
+        ret = sendmmsg( fw->fd, msgs + done, n - done, 0 );
+        if( ret < 0 && errno == EINTR ) continue;
+        if( ret <= 0 ) // the daemon is gone ( restarted ? ), reconnect later.
+        {
+            close( fw->fd );
+            fw->fd    = -1;
+            fw->retry = monotonic_now() + RETRY;
+            break;
+        }
+        done += ret;
+    }
+    pthread_mutex_lock( &( fw->lock ) );
+    fw->sent    += done;
+    fw->dropped += n - done;
+    pthread_mutex_unlock( &( fw->lock ) );
+}
+
+static void *sender_main( void *arg )
+{
+    struct logfwd *fw = arg;
+    int            head, n;
+
+    pthread_mutex_lock( &( fw->lock ) );
+    for(;;)
+    {
+        while( fw->count == 0 && !fw->stop ) pthread_cond_wait( &( fw->cond ), &( fw->lock ) );
+        if( fw->count == 0 ) break; // stopped, and drained.
+
+        head = fw->head;
+        n    = fw->count;
+        if( n > LOGFWD_BATCH ) n = LOGFWD_BATCH;
+        if( n > LOGFWD_QUEUE - head ) n = LOGFWD_QUEUE - head; // up to the end of the ring
+        pthread_mutex_unlock( &( fw->lock ) );
+
+        fwd_send( fw, head, n );
+
+        pthread_mutex_lock( &( fw->lock ) );
+        fw->head   = ( head + n ) % LOGFWD_QUEUE;
+        fw->count -= n;
+    }
+    pthread_mutex_unlock( &( fw->lock ) );
+    return NULL;
+}
+
+struct logfwd *logfwd_start( int mode )
+{
+    struct logfwd *fw = calloc( sizeof( struct logfwd ), 1 );
+    pthread_attr_t attr;
+
+    if( fw == NULL ) return NULL;
+
+    fw->mode = mode;
+    fw->ring = malloc( sizeof( struct logline ) * LOGFWD_QUEUE );
+    if( fw->ring == NULL ) return NULL;
+
+    pthread_mutex_init( &( fw->lock ), NULL );
+    pthread_cond_init( &( fw->cond ), NULL );
+    fwd_connect( fw ); // or later.
+    pthread_attr_init( &attr );
+    pthread_attr_setstacksize( &attr, LOGFWD_STACK );
+    if( pthread_create( &( fw->thread ), &attr, sender_main, fw ) != 0 ) return NULL;
+    return fw;
+}
+
+/*
+ * send what is queued, and stop the sender.
+ */
+void logfwd_stop( struct logfwd *fw )
+{
+    pthread_mutex_lock( &( fw->lock ) );
+    fw->stop = 1;
+    pthread_cond_signal( &( fw->cond ) );
+    pthread_mutex_unlock( &( fw->lock ) );
+    pthread_join( fw->thread, NULL );
+}
+
+/*
+ * "[facility.]level" -> priority, -1 if unknown.
+ */
+int logfwd_priority( const char *name, int facility )
+{
+    const char *dot = strchr( name, '.' ), *level = name;
+    int         i;
+
+    if( dot != NULL )
+    {
+        for( i = 0 ; facilitynames[i].c_name != NULL ; i ++ )
+        {
+            if( strncmp( facilitynames[i].c_name, name, dot - name ) == 0
+             && facilitynames[i].c_name[ dot - name ] == '\0' ) break;
+        }
+        if( facilitynames[i].c_name == NULL ) return -1;
+
+        facility = facilitynames[i].c_val;
+        level    = dot + 1;
+    }
+    for( i = 0 ; prioritynames[i].c_name != NULL ; i ++ )
+    {
+        if( strcmp( prioritynames[i].c_name, level ) == 0 )
+            return facility | prioritynames[i].c_val;
+    }
+    return -1;
+}
+
+/*
+ * new stream, the header is formatted here once.
+ */
+struct logstream *logfwd_stream( struct logfwd *fw, int priority, const char *ident, pid_t pid )
+{
+    struct logstream *s;
+
+    pthread_mutex_lock( &( fw->lock ) );
+    if( ( s = fw->spare ) != NULL )
+    {
+        fw->spare = s->next;
+        fw->nspare --;
+        memset( s, 0x00, sizeof( struct logstream ) );
+    }
+    pthread_mutex_unlock( &( fw->lock ) );
+    if( s == NULL && ( s = calloc( sizeof( struct logstream ), 1 ) ) == NULL ) return NULL;
+
+    s->journal = ( fw->mode == LOGFWD_JOURNAL );
+    if( s->journal )
+        s->hdrlen = snprintf( s->hdr, sizeof( s->hdr ),
+                              "PRIORITY=%d\nSYSLOG_FACILITY=%d\nSYSLOG_IDENTIFIER=%s\nSYSLOG_PID=%d\nMESSAGE=",
+                              LOG_PRI( priority ), LOG_FAC( priority ), ident, (int)pid );
+    else
+        s->hdrlen = snprintf( s->hdr, sizeof( s->hdr ), "<%d>%s[%d]: ", priority, ident, (int)pid );
+    if( s->hdrlen >= (int)sizeof( s->hdr ) ) s->hdrlen = sizeof( s->hdr ) -1;
+    return s;
+}
+
+/*
+ * private method: queue one line. lock is held.
+ */
+static void put( struct logfwd *fw, const struct logstream *s, const char *line, int len )
+{
+    struct logline *l;
+
+    if( fw->count >= LOGFWD_QUEUE )
+    {
+        fw->dropped ++;
+        return ;
+    }
+    l = &( fw->ring[ ( fw->head + fw->count ) % LOGFWD_QUEUE ] );
+    memcpy( l->buff, s->hdr, s->hdrlen );
+    memcpy( l->buff + s->hdrlen, line, len );
+    l->len = s->hdrlen + len;
+    if( s->journal ) l->buff[ l->len ++ ] = '\n';
+    fw->count ++;
+}
+
+/*
+ * split a chunk of the output into lines, and queue them.
+ */
+void logfwd_lines( struct logfwd *fw, struct logstream *s, const char *buff, int siz )
+{
+    const char *p = buff, *e = buff + siz, *nl;
+    int         room = LOGFWD_LINEMAX - s->hdrlen - 1, len, wake;
+
+    pthread_mutex_lock( &( fw->lock ) );
+    wake = ( fw->count == 0 );
+    while( p < e )
+    {
+        nl  = memchr( p, '\n', e - p );
+        len = ( nl == NULL ) ? e - p : nl - p;
+        if( s->partlen + len > room ) // too long, split.
+        {
+            len = room - s->partlen;
+            nl  = NULL;
+        }
+        memcpy( s->part + s->partlen, p, len );
+        s->partlen += len;
+        p += len;
+        if( nl != NULL ) p ++; // newline
+        else if( p == e ) break; // the rest comes later.
+
+        put( fw, s, s->part, s->partlen );
+        s->partlen = 0;
+    }
+    if( wake && fw->count > 0 ) pthread_cond_signal( &( fw->cond ) );
+    pthread_mutex_unlock( &( fw->lock ) );
+}
+
+/*
+ * the stream is closed, queue the line without newline.
+ */
+void logfwd_flush( struct logfwd *fw, struct logstream *s )
+{
+    if( s->partlen == 0 ) return ;
+
+    pthread_mutex_lock( &( fw->lock ) );
+    put( fw, s, s->part, s->partlen );
+    s->partlen = 0;
+    pthread_cond_signal( &( fw->cond ) );
+    pthread_mutex_unlock( &( fw->lock ) );
+}
+
+/*
+ * the stream is not used any more.
+ */
+void logfwd_release( struct logfwd *fw, struct logstream *s )
+{
+    pthread_mutex_lock( &( fw->lock ) );
+    if( fw->nspare < fw->keep )
+    {
+        s->next   = fw->spare;
+        fw->spare = s;
+        fw->nspare ++;
+        s = NULL;
+    }
+    pthread_mutex_unlock( &( fw->lock ) );
+    free( s );
+}
+
+/*
+ * preallocate n streams, so that logfwd_stream() doesn't malloc.
+ * returns -1 if out of memory.
+ */
+int logfwd_reserve( struct logfwd *fw, int n )
+{
+    struct logstream *s;
+
+    pthread_mutex_lock( &( fw->lock ) );
+    fw->keep = n;
+    while( fw->nspare < n && ( s = calloc( sizeof( struct logstream ), 1 ) ) != NULL )
+    {
+        s->next   = fw->spare;
+        fw->spare = s;
+        fw->nspare ++;
+    }
+    pthread_mutex_unlock( &( fw->lock ) );
+    return ( fw->nspare < n ) ? -1 : 0;
+}
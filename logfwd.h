@@ -0,0 +1,68 @@
+/*
+ * logfwd.h : forward the output of the children to syslog / journald.
+ *
+ *  each line is a datagram to the local log socket, the header ( priority,
+ *  identifier and pid ) is formatted once per stream and copied in front.
+ *  the log pump puts lines into a bounded queue, a sender thread sends
+ *  them in batches by sendmmsg(). if the log daemon is slow and the queue
+ *  is full, lines are dropped ( and counted ), the child never waits.
+ */
+#ifndef __WATCHER_LOGFWD_H__
+#define __WATCHER_LOGFWD_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define LOGFWD_SYSLOG   1   /* /dev/log, "<pri>ident[pid]: line" */
+#define LOGFWD_JOURNAL  2   /* journald native protocol */
+
+#define LOGFWD_LINEMAX  2048    /* header + line, longer lines are split */
+#define LOGFWD_HDRMAX   256
+#define LOGFWD_QUEUE    1024    /* lines */
+#define LOGFWD_BATCH    64      /* lines per sendmmsg() */
+#define LOGFWD_STACK    ( 256 * 1024 )
+
+struct logline {
+    int               len;
+    char              buff[LOGFWD_LINEMAX];
+};
+
+/* one stream ( stdout or stderr of an instance ) */
+struct logstream {
+    struct logstream *next;     /* spares */
+    int               hdrlen;
+    char              hdr[LOGFWD_HDRMAX];
+    int               journal;
+    int               partlen;  /* line without newline yet */
+    char              part[LOGFWD_LINEMAX];
+};
+
+struct logfwd {
+    int               mode;
+    int               fd;       /* -1 if not connected */
+    int64_t           retry;    /* next connect, CLOCK_MONOTONIC nsec */
+    pthread_t         thread;
+    pthread_mutex_t   lock;     /* ring and counters */
+    pthread_cond_t    cond;
+    int               stop;
+    int               head;     /* oldest */
+    int               count;
+    struct logline   *ring;
+    uint64_t          sent;
+    uint64_t          dropped;  /* queue full, or the daemon is gone */
+    struct logstream *spare;    /* released streams kept for reuse */
+    int               nspare;
+    int               keep;     /* spares to keep, logfwd_reserve() */
+};
+
+struct logfwd    *logfwd_start( int mode );
+void              logfwd_stop( struct logfwd *fw );
+int               logfwd_priority( const char *name, int facility );
+struct logstream *logfwd_stream( struct logfwd *fw, int priority, const char *ident, pid_t pid );
+void              logfwd_lines( struct logfwd *fw, struct logstream *s, const char *buff, int siz );
+void              logfwd_flush( struct logfwd *fw, struct logstream *s );
+void              logfwd_release( struct logfwd *fw, struct logstream *s );
+int               logfwd_reserve( struct logfwd *fw, int n );
+
+#endif /* __WATCHER_LOGFWD_H__ */
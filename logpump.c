@@ -0,0 +1,1151 @@
+/*
+ * logpump.c : multi-threaded log pump for watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#define _GNU_SOURCE
+#include "logpump.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+
+#define CMD_ADD   1
+#define CMD_DEL   2
+#define CMD_MOVE  3
+
+/* user_data of io_uring, others are logpipes ( | 1 : poll ). */
+#define UD_CMD    2
+#define UD_CANCEL 4
+
+#define PARK_READ   1
+#define PARK_POLL   2
+#define PARK_CANCEL 3
+#define PARK_RETRY  1000000LL /* nsec, wait of a worker with parked pipes */
+
+#define ROTATE_CHECK   1000000000LL  /* rotation check interval, nsec */
+#define LOGFILE_NOTICE 60000000000LL /* syslog of throttling at most once a minute */
+
+static int64_t monotonic_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * log file, opened lazily by writelog().
+ */
+struct logfile *logfile_new( const char *name )
+{
+    struct logfile *f = calloc( sizeof( struct logfile ), 1 );
+
+    if( f == NULL ) return NULL;
+
+    f->name = strdup( name );
+    f->fd   = -1;
+    if( f->name == NULL || stat( name, &( f->st ) ) < 0 )
+       memset( &( f->st ), 0x00, sizeof( f->st ) );
+    pthread_mutex_init( &( f->lock ), NULL );
+    return f;
+}
+
+/*
+ * private method: the file was rotated ( or removed ) ?
+ */
+static int rotated( struct logfile *f, int64_t now )
+{
+    struct stat stbuf;
+
+    if( f->fd < 0 ) return 1;
+    if( now - f->checked < ROTATE_CHECK ) return 0;
+
+    f->checked = now;
+    if( stat( f->name, &stbuf ) < 0 ) return 1;
+
+    return ( stbuf.st_ino != f->st.st_ino ) || ( stbuf.st_dev != f->st.st_dev );
+}
+
+/*
+ * rate limit of an instance, name is in its summary. rate 0 is unlimited,
+ * burst 0 is 1 sec of rate.
+ */
+struct loglimit *loglimit_new( const char *name, double bytes, double bburst, double lines, double lburst )
+{
+    struct loglimit *l = calloc( sizeof( struct loglimit ), 1 );
+    int64_t          now = monotonic_now();
+
+    if( l == NULL ) return NULL;
+    if( ( l->name = strdup( name ) ) == NULL )
+    {
+        free( l );
+        return NULL;
+    }
+    pthread_mutex_init( &( l->lock ), NULL );
+    rate_bucket_init( &( l->bytes ), bytes, ( bburst > 0.0 ) ? bburst : bytes, now );
+    rate_bucket_init( &( l->lines ), lines, ( lburst > 0.0 ) ? lburst : lines, now );
+    return l;
+}
+
+/*
+ * private method: write a chunk to the log file. re-open if rotated.
+ * lock is held.
+ */
+static int file_write( struct logfile *f, const char *buff, int siz, int64_t now )
+{
+    int ret;
+
+    if( rotated( f, now ) )
+    {
+        if( f->fd >= 0 ) close( f->fd );
+        f->fd = open( f->name, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC,
+                      ( f->st.st_mode > 0 ) ? ( f->st.st_mode & 07777 ) : 0644 );
+        if( f->fd < 0 )
+        {
+            syslog( LOG_WARNING, "can't re-open '%s', reason '%s', msg '%.*s'",
+                                  f->name, strerror( errno ), siz, buff );
+            return -1;
+        }
+        if( getuid() == 0 )
+        {
+            if( f->st.st_uid != 0 || f->st.st_gid != 0 )
+            {
+                fchown( f->fd, f->st.st_uid, f->st.st_gid );
+            }
+        }
+        fstat( f->fd, &( f->st ) );
+    }
+    ret = write( f->fd, buff, siz );
+    if( ret > 0 ) f->stat.bytes += ret;
+    return ret;
+}
+
+/*
+ * private method: the limit cleared, the summary to buff. lock is held.
+ */
+static int unsuppress( struct loglimit *l, int64_t now, char *buff, int size )
+{
+    int siz;
+
+    siz = snprintf( buff, size, "watcher: %s suppressed %llu lines / %llu bytes in %.1f seconds\n",
+                    l->name, (unsigned long long)l->slines, (unsigned long long)l->sbytes,
+                    (double)( now - l->since ) / 1e9 );
+    l->since  = 0;
+    l->slines = 0;
+    l->sbytes = 0;
+    return ( siz < size ) ? siz : size - 1;
+}
+
+/*
+ * private method: suppression ends when the buckets are full again,
+ * so a steady flood gives one burst and one summary per refill time.
+ */
+static int cleared( struct loglimit *l, int64_t now )
+{
+    return rate_bucket_wait( &( l->bytes ), now, l->bytes.burst ) == 0
+        && rate_bucket_wait( &( l->lines ), now, l->lines.burst ) == 0;
+}
+
+/*
+ * private method: how much of buff is within the limit, by lines.
+ * lock is held.
+ */
+static int limit( struct loglimit *l, const char *buff, int siz, int64_t now )
+{
+    const char *p = buff, *e = buff + siz, *nl;
+    double      len, line;
+
+    if( l->bytes.rate <= 0.0 && l->lines.rate <= 0.0 ) return siz;
+    if( l->since != 0 && !cleared( l, now ) ) return 0;
+
+    for( ; p < e ; p += (int)len )
+    {
+        nl   = memchr( p, '\n', e - p );
+        len  = ( nl == NULL ) ? e - p : nl + 1 - p;
+        line = ( nl == NULL ) ? 0.0 : 1.0; // a fragment is counted by bytes only.
+
+        // a line longer than the burst takes the whole bucket.
+        if( rate_bucket_wait( &( l->bytes ), now, len < l->bytes.burst ? len : l->bytes.burst ) > 0
+         || rate_bucket_wait( &( l->lines ), now, line ) > 0 ) break;
+
+        rate_bucket_take( &( l->bytes ), now, len < l->bytes.burst ? len : l->bytes.burst );
+        rate_bucket_take( &( l->lines ), now, line );
+    }
+    return p - buff;
+}
+
+/*
+ * private method: discard over the limit. lock is held.
+ */
+static void suppress( struct loglimit *l, const char *buff, int siz, int64_t now )
+{
+    const char *p = buff, *e = buff + siz;
+    uint64_t    lines = 0;
+
+    if( l->since == 0 )
+    {
+        l->since = now;
+        l->stat.periods ++;
+        if( now - l->noticed >= LOGFILE_NOTICE )
+        {
+            l->noticed = now;
+            syslog( LOG_NOTICE, "log of %s is over the rate limit, suppressing.", l->name );
+        }
+    }
+    while( p < e && ( p = memchr( p, '\n', e - p ) ) != NULL )
+    {
+        lines ++;
+        p ++;
+    }
+    l->slines      += lines;
+    l->sbytes      += siz;
+    l->stat.slines += lines;
+    l->stat.sbytes += siz;
+}
+
+/*
+ * write a chunk to the log file, within the rate limit l ( or NULL ).
+ */
+int writelog( struct logfile *f, struct loglimit *l, const char *buff, int siz )
+{
+    int64_t now = monotonic_now();
+    char    summary[256];
+    int     ret = 0, n = siz, s = 0;
+
+    if( l != NULL )
+    {
+        pthread_mutex_lock( &( l->lock ) );
+        n = limit( l, buff, siz, now );
+        if( n > 0 && l->since != 0 ) s = unsuppress( l, now, summary, sizeof( summary ) );
+        if( n < siz ) suppress( l, buff + n, siz - n, now );
+        pthread_mutex_unlock( &( l->lock ) );
+    }
+    if( n == 0 ) return 0;
+
+    pthread_mutex_lock( &( f->lock ) );
+    if( s > 0 ) file_write( f, summary, s, now );
+    ret = file_write( f, buff, n, now );
+    pthread_mutex_unlock( &( f->lock ) );
+    return ret;
+}
+
+/*
+ * no output for a while. write the summary if the limit cleared.
+ */
+void loglimit_idle( struct loglimit *l, struct logfile *f )
+{
+    int64_t now = monotonic_now();
+    char    summary[256];
+    int     s = 0;
+
+    pthread_mutex_lock( &( l->lock ) );
+    if( l->since != 0 && cleared( l, now ) ) s = unsuppress( l, now, summary, sizeof( summary ) );
+    pthread_mutex_unlock( &( l->lock ) );
+    if( s == 0 ) return ;
+
+    pthread_mutex_lock( &( f->lock ) );
+    file_write( f, summary, s, now );
+    pthread_mutex_unlock( &( f->lock ) );
+}
+
+/*
+ * private method: queue a command to the worker. pump lock is held.
+ */
+static void post( struct logworker *w, struct logpipe *lp, int op )
+{
+    uint64_t one = 1;
+
+    lp->op      = op;
+    lp->queued  = 1;
+    lp->cmdnext = NULL;
+   *w->cmdtail  = lp;
+    w->cmdtail  = &( lp->cmdnext );
+    write( w->evfd, &one, sizeof( one ) );
+}
+
+/*
+ * private method: tee what is in the pipe to the subscribers, and
+ * returns the size to read. a subscriber which can't take all is dropped.
+ *   buff : already read ( io_uring ), avail of it is written instead.
+ */
+static int pump_tee( struct logpump *p, struct logpipe *lp, const char *buff, int avail )
+{
+    struct logsub **sp, *s;
+    int             siz;
+
+    if( buff == NULL )
+    {
+        if( ioctl( lp->fd, FIONREAD, &avail ) < 0 || avail <= 0 ) return LOGPUMP_BUFSIZ;
+        if( avail > LOGPUMP_BUFSIZ ) avail = LOGPUMP_BUFSIZ;
+    }
+
+    pthread_mutex_lock( &( p->sublock ) );
+    for( sp = &( p->subs ) ; ( s = *sp ) != NULL ; )
+    {
+        if( buff == NULL )
+            siz = tee( lp->fd, s->fd, avail, SPLICE_F_NONBLOCK );
+        else
+            siz = write( s->fd, buff, avail );
+        if( siz == avail )
+        {
+            sp = &( s->next );
+            continue;
+        }
+        if( siz >= 0 || errno == EAGAIN )
+        {
+            p->dropped ++;
+            if( p->debug > 0 )
+                fprintf( stderr, "logpump: subscriber %d is too slow, dropped.\n", s->fd );
+            else
+                syslog( LOG_NOTICE, "log subscriber too slow, dropped." );
+        }
+       *sp = s->next; // EPIPE if gone.
+        close( s->fd );
+        free( s );
+        __atomic_sub_fetch( &( p->nsubs ), 1, __ATOMIC_RELAXED );
+    }
+    pthread_mutex_unlock( &( p->sublock ) );
+    return avail;
+}
+
+/*
+ * private method: what is read from the pipe, to the outputs.
+ */
+static void pump_data( struct logworker *w, struct logpipe *lp, const char *buff, int siz )
+{
+    if( lp->file   != NULL ) writelog( lp->file, lp->limit, buff, siz );
+    if( lp->stream != NULL ) logfwd_lines( lp->fwd, lp->stream, buff, siz );
+    if( lp->tail   != NULL ) crashtail_write( lp->tail, buff, siz );
+    __atomic_add_fetch( &( lp->bytes ), siz, __ATOMIC_RELAXED );
+    w->chunks ++;
+}
+
+/*
+ * private method: one buffer from the ring, written in place. the ring
+ * is owned by the caller.
+ */
+static int shm_chunk( struct logworker *w, struct logpipe *lp )
+{
+    const char *buff, *nl;
+    int         siz = shmlog_peek( lp->shm, &buff, LOGPUMP_BUFSIZ );
+
+    if( siz == 0 )
+    {
+        shmlog_idle( lp->shm );
+        return -1;
+    }
+    // more to come, end at a line. stdout may be between the chunks.
+    if( siz == LOGPUMP_BUFSIZ && ( nl = memrchr( buff, '\n', siz ) ) != NULL )
+        siz = nl + 1 - buff;
+    if( __atomic_load_n( &( w->pump->nsubs ), __ATOMIC_RELAXED ) > 0 )
+        pump_tee( w->pump, lp, buff, siz );
+    pump_data( w, lp, buff, siz );
+    shmlog_consume( lp->shm, siz );
+    return siz;
+}
+
+/*
+ * private method: a ring may have two pipes for a moment ( the child was
+ * restarted ). the one which owns the ring drains it, the other one is
+ * woken again by the eventfd, not drained yet.
+ */
+static int pump_shm( struct logworker *w, struct logpipe *lp )
+{
+    int siz;
+
+    if( __atomic_exchange_n( &( lp->shm->owned ), 1, __ATOMIC_ACQUIRE ) ) return -1;
+    siz = shm_chunk( w, lp );
+    __atomic_store_n( &( lp->shm->owned ), 0, __ATOMIC_RELEASE );
+    return siz;
+}
+
+/*
+ * private method: read one buffer from the pipe. 0 on EOF.
+ */
+static int pump_read( struct logworker *w, struct logpipe *lp )
+{
+    int siz = LOGPUMP_BUFSIZ;
+
+    if( lp->shm != NULL ) return pump_shm( w, lp );
+
+    if( __atomic_load_n( &( w->pump->nsubs ), __ATOMIC_RELAXED ) > 0 )
+        siz = pump_tee( w->pump, lp, NULL, 0 ); // exactly what they got.
+
+    siz = read( lp->fd, w->buff, siz );
+    w->reads ++;
+
+    if( siz > 0 )
+    {
+        pump_data( w, lp, w->buff, siz );
+        return siz;
+    }
+    if( siz < 0 && ( errno == EAGAIN || errno == EINTR ) ) return -1;
+
+    return 0; // EOF or error
+}
+
+/*
+ * private method: drain what is left, and free. pump lock is held, but
+ * not while draining. the pipe is detached, only its worker has it.
+ */
+static void pump_free( struct logpump *p, struct logworker *w, struct logpipe *lp )
+{
+    struct logpipe **pp;
+
+    if( !lp->eof )
+    {
+        pthread_mutex_unlock( &( p->lock ) );
+        if( lp->shm != NULL ) // the next pipe may have it for a buffer.
+        {
+            while( __atomic_exchange_n( &( lp->shm->owned ), 1, __ATOMIC_ACQUIRE ) )
+                sched_yield();
+            while( shm_chunk( w, lp ) > 0 )
+                ;
+            __atomic_store_n( &( lp->shm->owned ), 0, __ATOMIC_RELEASE );
+        }
+        else
+        {
+            while( pump_read( w, lp ) > 0 )
+                ;
+        }
+        close( lp->fd );
+        pthread_mutex_lock( &( p->lock ) );
+    }
+    for( pp = &( p->pipes ) ; *pp != NULL ; pp = &( ( *pp )->next ) )
+    {
+        if( *pp == lp )
+        {
+           *pp = lp->next;
+            break;
+        }
+    }
+    lp->worker->npipes --;
+    if( lp->tail != NULL ) crashtail_drained( lp->tail, p->notify );
+    if( lp->stream != NULL )
+    {
+        logfwd_flush( lp->fwd, lp->stream );
+        logfwd_release( lp->fwd, lp->stream );
+    }
+    if( p->nspare < p->keep )
+    {
+        lp->next = p->spare;
+        p->spare = lp;
+        p->nspare ++;
+    }
+    else
+        free( lp );
+}
+
+/*
+ * private method: io_uring, no sqe for the pipe now. it is submitted
+ * after the next io_uring_enter(). pump lock is held.
+ */
+static void park( struct logworker *w, struct logpipe *lp, int what )
+{
+    if( lp->parked == 0 )
+    {
+        lp->parknext = w->parked;
+        w->parked    = lp;
+    }
+    lp->parked = what;
+}
+
+static void unpark( struct logworker *w, struct logpipe *lp )
+{
+    struct logpipe **pp;
+
+    if( lp->parked == 0 ) return ;
+    for( pp = &( w->parked ) ; *pp != NULL ; pp = &( ( *pp )->parknext ) )
+    {
+        if( *pp == lp )
+        {
+           *pp = lp->parknext;
+            break;
+        }
+    }
+    lp->parked = 0;
+}
+
+/*
+ * private method: io_uring, keep a read on the pipe. multishot if the
+ * kernel has it, else one shot and armed again. poll : wait for data
+ * first, the kernel may not wait on a non-blocking pipe by itself.
+ * a ring is always polled, its eventfd.
+ */
+static void arm( struct logworker *w, struct logpipe *lp, int poll )
+{
+    struct io_uring_sqe *sqe = uring_sqe( w->ring );
+
+    if( lp->shm != NULL ) poll = 1;
+
+    if( sqe == NULL )
+    {
+        park( w, lp, poll ? PARK_POLL : PARK_READ );
+        return ;
+    }
+    sqe->fd = lp->fd;
+    if( poll )
+    {
+        sqe->opcode      = IORING_OP_POLL_ADD;
+        sqe->poll_events = POLLIN;
+        sqe->user_data   = (uintptr_t)lp | 1;
+        lp->armed = 2;
+        return ;
+    }
+    sqe->opcode    = w->pump->multishot ? URING_OP_READ_MULTISHOT : IORING_OP_READ;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->len       = w->pump->multishot ? 0 : LOGPUMP_URING_BUFSIZ;
+    sqe->user_data = (uintptr_t)lp;
+    lp->armed = 1;
+}
+
+static void watch( struct logworker *w, struct logpipe *lp )
+{
+    struct epoll_event ev;
+
+    if( w->ring != NULL )
+    {
+        arm( w, lp, 0 );
+        return ;
+    }
+    ev.events   = EPOLLIN;
+    ev.data.ptr = lp;
+    epoll_ctl( w->epfd, EPOLL_CTL_ADD, lp->fd, &ev );
+}
+
+/*
+ * private method: io_uring, cancel the read ( or poll ) in flight.
+ */
+static void cancel( struct logworker *w, struct logpipe *lp )
+{
+    struct io_uring_sqe *sqe = uring_sqe( w->ring );
+
+    lp->cancel = 1;
+    if( sqe == NULL )
+    {
+        park( w, lp, PARK_CANCEL );
+        return ;
+    }
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->addr      = (uintptr_t)lp | ( lp->armed == 2 );
+    sqe->user_data = UD_CANCEL;
+}
+
+/*
+ * 1 if the read of io_uring is still in flight, the command has to wait
+ * for its end.
+ */
+static int unwatch( struct logworker *w, struct logpipe *lp )
+{
+    if( w->ring == NULL )
+    {
+        if( !lp->eof ) epoll_ctl( w->epfd, EPOLL_CTL_DEL, lp->fd, NULL );
+        return 0;
+    }
+    if( lp->parked == PARK_READ || lp->parked == PARK_POLL ) // not armed yet.
+    {
+        unpark( w, lp );
+        return 0;
+    }
+    if( !lp->armed ) return 0;
+    if( !lp->cancel ) cancel( w, lp );
+    return 1;
+}
+
+/*
+ * private method: submit what was parked, while there are sqes.
+ */
+static void unpark_all( struct logworker *w )
+{
+    struct logpump *p = w->pump;
+    struct logpipe *lp;
+    int             what;
+
+    pthread_mutex_lock( &( p->lock ) );
+    while( ( lp = w->parked ) != NULL )
+    {
+        w->parked  = lp->parknext;
+        what       = lp->parked;
+        lp->parked = 0;
+        if( what == PARK_CANCEL )
+            cancel( w, lp );
+        else
+            arm( w, lp, what == PARK_POLL );
+        if( lp->parked ) break; // still no sqe.
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+}
+
+/*
+ * private method: pump lock is held.
+ */
+static void command( struct logworker *w, struct logpipe *lp, int op )
+{
+    struct logpump *p = w->pump;
+
+    switch( op )
+    {
+    case CMD_ADD:
+        if( lp->detached )
+        {
+            pump_free( p, w, lp );
+            break;
+        }
+        if( lp->eof ) break;
+
+        watch( w, lp );
+        break;
+    case CMD_MOVE:
+        if( unwatch( w, lp ) )
+        {
+            if( lp->deferred != CMD_DEL ) lp->deferred = CMD_MOVE;
+            break;
+        }
+        if( lp->detached )
+        {
+            pump_free( p, w, lp );
+            break;
+        }
+        w->npipes --;
+        lp->worker = lp->target;
+        lp->worker->npipes ++;
+        post( lp->worker, lp, CMD_ADD );
+        break;
+    case CMD_DEL:
+        if( unwatch( w, lp ) )
+        {
+            lp->deferred = CMD_DEL;
+            break;
+        }
+        pump_free( p, w, lp );
+        break;
+    }
+}
+
+static void do_commands( struct logworker *w )
+{
+    struct logpump     *p = w->pump;
+    struct logpipe     *lp, *next;
+    uint64_t            cnt;
+
+    read( w->evfd, &cnt, sizeof( cnt ) );
+
+    pthread_mutex_lock( &( p->lock ) );
+    lp = w->cmds;
+    w->cmds    = NULL;
+    w->cmdtail = &( w->cmds );
+    for( ; lp != NULL ; lp = next )
+    {
+        next = lp->cmdnext;
+        lp->queued = 0;
+        command( w, lp, lp->op );
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+}
+
+/*
+ * private method: move the hottest pipe of the busiest worker to the
+ * idlest worker, if it makes them more even.
+ */
+static void rebalance( struct logpump *p )
+{
+    struct logworker *busy = NULL, *idle = NULL;
+    struct logpipe   *lp, *hot = NULL;
+    int               i;
+
+    pthread_mutex_lock( &( p->lock ) );
+    for( i = 0 ; i < p->nworkers ; i ++ ) p->workers[i].load = 0;
+
+    for( lp = p->pipes ; lp != NULL ; lp = lp->next )
+    {
+        uint64_t b = __atomic_load_n( &( lp->bytes ), __ATOMIC_RELAXED );
+
+        lp->load  = b - lp->mark;
+        lp->mark  = b;
+        lp->worker->load += lp->load;
+    }
+    for( i = 0 ; i < p->nworkers ; i ++ )
+    {
+        struct logworker *w = &( p->workers[i] );
+
+        if( busy == NULL || w->load > busy->load ) busy = w;
+        if( idle == NULL || w->load < idle->load ) idle = w;
+    }
+    if( busy == idle || busy->npipes < 2 || busy->load < LOGPUMP_BUFSIZ )
+    {
+        pthread_mutex_unlock( &( p->lock ) );
+        return ;
+    }
+    for( lp = p->pipes ; lp != NULL ; lp = lp->next )
+    {
+        if( lp->worker != busy || lp->queued || lp->detached || lp->eof || lp->deferred ) continue;
+        if( hot == NULL || lp->load > hot->load ) hot = lp;
+    }
+    if( hot != NULL && hot->load > 0 && idle->load + hot->load < busy->load )
+    {
+        if( p->debug > 0 )
+            fprintf( stderr, "logpump: move fd %d from worker %d to %d ( %llu bytes/period )\n",
+                     hot->fd, busy->id, idle->id, (unsigned long long)hot->load );
+        hot->target = idle;
+        post( busy, hot, CMD_MOVE );
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+}
+
+/*
+ * private method: flush the suppression summary of quiet instances. the
+ * pairs are taken under the pump lock, and written without it. limits
+ * and files live as long as the pump.
+ */
+static void idle_files( struct logpump *p )
+{
+    struct { struct loglimit *l; struct logfile *f; } *idle;
+    struct logpipe *lp;
+    int             i, n = 0;
+
+    pthread_mutex_lock( &( p->lock ) );
+    for( lp = p->pipes ; lp != NULL ; lp = lp->next ) n ++;
+    if( n == 0 || ( idle = malloc( sizeof( *idle ) * n ) ) == NULL )
+    {
+        pthread_mutex_unlock( &( p->lock ) );
+        return ;
+    }
+    for( n = 0, lp = p->pipes ; lp != NULL ; lp = lp->next )
+    {
+        if( lp->limit == NULL || lp->file == NULL ) continue;
+        idle[n].l = lp->limit;
+        idle[n].f = lp->file;
+        n ++;
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+
+    for( i = 0 ; i < n ; i ++ ) loglimit_idle( idle[i].l, idle[i].f );
+    free( idle );
+}
+
+static void housekeeping( struct logworker *w )
+{
+    struct logpump *p = w->pump;
+
+    if( w->id == 0 && monotonic_now() - p->balanced >= LOGPUMP_BALANCE )
+    {
+        p->balanced = monotonic_now();
+        if( p->nworkers > 1 ) rebalance( p );
+        idle_files( p );
+    }
+}
+
+/*
+ * private method: io_uring, the read ( or poll ) of the pipe is over.
+ */
+static void ended( struct logworker *w, struct logpipe *lp, int res, int poll )
+{
+    struct logpump *p = w->pump;
+    int             op;
+
+    pthread_mutex_lock( &( p->lock ) );
+    unpark( w, lp ); // a cancel not sent yet.
+    lp->armed  = 0;
+    lp->cancel = 0;
+    if( ( op = lp->deferred ) != 0 )
+    {
+        lp->deferred = 0;
+        command( w, lp, op );
+    }
+    else if( res > 0 || res == -ENOBUFS ) // one shot, or out of buffers for a moment.
+        arm( w, lp, 0 );
+    else if( res == -EAGAIN && !poll )
+        arm( w, lp, 1 );
+    else
+    {
+        close( lp->fd );
+        lp->eof = 1; // freed when detached.
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+}
+
+/*
+ * private method: the wait of the worker failed. logged once, and tried
+ * again a little later. the pipes stay with the worker, nobody else reads them.
+ */
+static void wait_failed( struct logworker *w, const char *what )
+{
+    struct timespec ts = { 0, PARK_RETRY };
+
+    if( !w->failing )
+    {
+        if( w->pump->debug > 0 )
+            fprintf( stderr, "logging thread %d, %s, %s\n", w->id, what, strerror( errno ) );
+        else
+            syslog( LOG_ERR, "logging thread %d, %s, %m", w->id, what );
+    }
+    w->failing = 1;
+    nanosleep( &ts, NULL );
+}
+
+static void worker_uring( struct logworker *w )
+{
+    struct logpump      *p = w->pump;
+    struct uring        *u = w->ring;
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    int                  cmd;
+
+    w->wake = 1;
+    while( !p->stop )
+    {
+        if( w->wake && ( sqe = uring_sqe( u ) ) != NULL ) // commands wake us up.
+        {
+            sqe->opcode      = IORING_OP_POLL_ADD;
+            sqe->fd          = w->evfd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data   = UD_CMD;
+            w->wake = 0;
+        }
+        w->waits ++;
+        if( uring_enter( u, 1, ( w->wake || w->parked != NULL ) ? PARK_RETRY : LOGPUMP_BALANCE ) < 0
+         && errno != EBUSY )
+            wait_failed( w, "io_uring_enter()" );
+        else
+            w->failing = 0;
+        for( cmd = 0 ; ( cqe = uring_cqe( u ) ) != NULL ; uring_cqe_seen( u ) )
+        {
+            uint64_t        ud = cqe->user_data;
+            struct logpipe *lp = (struct logpipe *)(uintptr_t)( ud & ~1ULL );
+
+            if( ud == UD_CMD ) cmd = w->wake = 1;
+            if( ud == UD_CMD || ud == UD_CANCEL ) continue;
+
+            if( !( ud & 1 ) && cqe->res > 0 )
+            {
+                unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+                if( __atomic_load_n( &( p->nsubs ), __ATOMIC_RELAXED ) > 0 )
+                    pump_tee( p, lp, uring_buf( u, id ), cqe->res );
+                pump_data( w, lp, uring_buf( u, id ), cqe->res );
+                uring_buf_return( u, id );
+            }
+            if( ( ud & 1 ) && lp->shm != NULL && cqe->res > 0 ) pump_shm( w, lp );
+            if( cqe->flags & IORING_CQE_F_MORE ) continue;
+            ended( w, lp, cqe->res, ud & 1 );
+        }
+        if( cmd ) do_commands( w ); // after this batch, pipes in it may be freed.
+        if( w->parked != NULL ) unpark_all( w );
+        housekeeping( w );
+    }
+}
+
+static void worker_epoll( struct logworker *w )
+{
+    struct logpump     *p = w->pump;
+    struct epoll_event  evs[64];
+    int                 i, n, cmd;
+
+    while( !p->stop )
+    {
+        w->waits ++;
+        n = epoll_wait( w->epfd, evs, 64, LOGPUMP_BALANCE / 1000000 );
+        if( n < 0 && errno != EINTR )
+            wait_failed( w, "epoll_wait()" );
+        else
+            w->failing = 0;
+        for( i = cmd = 0 ; i < n ; i ++ )
+        {
+            struct logpipe *lp = evs[i].data.ptr;
+
+            if( lp == NULL )
+            {
+                cmd = 1; // after this batch, pipes in it may be freed.
+                continue;
+            }
+            if( lp->eof ) continue;
+            if( lp->shm != NULL )
+            {
+                pump_shm( w, lp );
+                continue;
+            }
+            if( pump_read( w, lp ) == 0 )
+            {
+                pthread_mutex_lock( &( p->lock ) );
+                epoll_ctl( w->epfd, EPOLL_CTL_DEL, lp->fd, NULL );
+                close( lp->fd );
+                lp->eof = 1; // freed when detached.
+                pthread_mutex_unlock( &( p->lock ) );
+            }
+        }
+        if( cmd ) do_commands( w );
+        housekeeping( w );
+    }
+}
+
+static void *worker_main( void *arg )
+{
+    struct logworker   *w = arg;
+    struct logpump     *p = w->pump;
+    sigset_t            mask;
+
+    // tee() to a closed subscriber raises SIGPIPE, keep it to this thread.
+    sigemptyset( &mask );
+    sigaddset( &mask, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &mask, NULL );
+
+    if( p->pinned && placement_pin_self( &( p->pin ) ) < 0 )
+        syslog( LOG_WARNING, "can't pin logging thread %d, %m", w->id );
+
+    if( w->ring != NULL )
+        worker_uring( w );
+    else
+        worker_epoll( w );
+    return NULL;
+}
+
+/*
+ * private method: io_uring for the worker, -1 if the kernel can't.
+ */
+static int uring_worker( struct logpump *p, struct logworker *w )
+{
+    w->ring = calloc( sizeof( struct uring ), 1 );
+    if( w->ring == NULL ) return -1;
+
+    if( uring_init( w->ring, LOGPUMP_URING_DEPTH ) < 0 )
+    {
+        free( w->ring );
+        w->ring = NULL;
+        return -1;
+    }
+    if( !uring_supported( w->ring, IORING_OP_READ )
+     || !uring_supported( w->ring, IORING_OP_POLL_ADD )
+     || !uring_supported( w->ring, IORING_OP_ASYNC_CANCEL )
+     || uring_buffers( w->ring, LOGPUMP_URING_BUFS, LOGPUMP_URING_BUFSIZ ) < 0 )
+    {
+        uring_exit( w->ring );
+        free( w->ring );
+        w->ring = NULL;
+        errno = ENOSYS;
+        return -1;
+    }
+    p->multishot = uring_supported( w->ring, URING_OP_READ_MULTISHOT );
+    p->uring ++;
+    return 0;
+}
+
+/*
+ * pin : cpus for the workers ( housekeeping cores ), NULL if not pinned.
+ * uring : on io_uring if the kernel has it, else on epoll.
+ */
+struct logpump *logpump_start( int nworkers, int debug, const struct cpumask *pin, int uring )
+{
+    struct logpump     *p;
+    struct epoll_event  ev;
+    pthread_attr_t      attr;
+    int                 i;
+
+    if( nworkers < 1 ) nworkers = 1;
+    if( nworkers > LOGPUMP_MAXWORKERS ) nworkers = LOGPUMP_MAXWORKERS;
+
+    p = calloc( sizeof( struct logpump ) + sizeof( struct logworker ) * nworkers, 1 );
+    if( p == NULL ) return NULL;
+
+    p->nworkers = nworkers;
+    p->debug    = debug;
+    p->balanced = monotonic_now();
+    p->notify   = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if( p->notify < 0 ) return NULL;
+    if( pin != NULL )
+    {
+        p->pinned = 1;
+        p->pin    = *pin;
+    }
+    pthread_mutex_init( &( p->lock ), NULL );
+    pthread_mutex_init( &( p->sublock ), NULL );
+    pthread_attr_init( &attr );
+    pthread_attr_setstacksize( &attr, LOGPUMP_STACK );
+
+    for( i = 0 ; i < nworkers ; i ++ )
+    {
+        struct logworker *w = &( p->workers[i] );
+
+        w->pump    = p;
+        w->id      = i;
+        w->cmdtail = &( w->cmds );
+        w->buff    = malloc( LOGPUMP_BUFSIZ );
+        w->epfd    = -1;
+        w->evfd    = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        if( w->buff == NULL || w->evfd < 0 ) return NULL;
+
+        if( uring && uring_worker( p, w ) < 0 )
+        {
+            if( debug > 0 )
+                fprintf( stderr, "logpump: no io_uring for worker %d ( %s ), epoll.\n", i, strerror( errno ) );
+            else
+                syslog( LOG_NOTICE, "no io_uring for logging thread %d, %m, epoll." , i );
+        }
+        if( w->ring == NULL )
+        {
+            if( ( w->epfd = epoll_create1( EPOLL_CLOEXEC ) ) < 0 ) return NULL;
+            ev.events   = EPOLLIN;
+            ev.data.ptr = NULL;
+            epoll_ctl( w->epfd, EPOLL_CTL_ADD, w->evfd, &ev );
+        }
+        if( pthread_create( &( w->thread ), &attr, worker_main, w ) != 0 ) return NULL;
+    }
+    return p;
+}
+
+void logpump_stop( struct logpump *p )
+{
+    uint64_t one = 1;
+    int      i;
+
+    p->stop = 1;
+    for( i = 0 ; i < p->nworkers ; i ++ ) write( p->workers[i].evfd, &one, sizeof( one ) );
+    for( i = 0 ; i < p->nworkers ; i ++ ) pthread_join( p->workers[i].thread, NULL );
+}
+
+/*
+ * private method: fd, or the eventfd of shm.
+ */
+static struct logpipe *add( struct logpump *p, int fd, struct shmlog *shm, struct logfile *f,
+                            struct loglimit *l, struct logfwd *fwd, struct logstream *stream,
+                            struct crashtail *tail )
+{
+    struct logpipe   *lp;
+    struct logworker *w = NULL;
+    int               i;
+
+    pthread_mutex_lock( &( p->lock ) );
+    if( ( lp = p->spare ) != NULL )
+    {
+        p->spare = lp->next;
+        p->nspare --;
+        memset( lp, 0x00, sizeof( struct logpipe ) );
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+    if( lp == NULL && ( lp = calloc( sizeof( struct logpipe ), 1 ) ) == NULL ) return NULL;
+
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+    lp->fd     = fd;
+    lp->file   = f;
+    lp->limit  = l;
+    lp->fwd    = fwd;
+    lp->stream = stream;
+    lp->tail   = tail;
+    lp->shm    = shm;
+
+    pthread_mutex_lock( &( p->lock ) );
+    for( i = 0 ; i < p->nworkers ; i ++ )
+    {
+        if( w == NULL || p->workers[i].npipes < w->npipes ) w = &( p->workers[i] );
+    }
+    lp->worker = w;
+    w->npipes ++;
+    lp->next   = p->pipes;
+    p->pipes   = lp;
+    post( w, lp, CMD_ADD );
+    pthread_mutex_unlock( &( p->lock ) );
+    return lp;
+}
+
+/*
+ * hand the pipe to the worker with fewest pipes.
+ *   f : log file, l : rate limit of the instance, fwd and stream : forwarder,
+ *   tail : crash tail. any may be NULL. stream is freed with the pipe.
+ */
+struct logpipe *logpump_add( struct logpump *p, int fd, struct logfile *f, struct loglimit *l,
+                             struct logfwd *fwd, struct logstream *stream,
+                             struct crashtail *tail )
+{
+    return add( p, fd, NULL, f, l, fwd, stream, tail );
+}
+
+/*
+ * the ring of a child, pumped like a pipe. the pipe has a dup() of the
+ * eventfd, the last one may be still draining in the same epoll.
+ */
+struct logpipe *logpump_add_shm( struct logpump *p, struct shmlog *shm, struct logfile *f, struct loglimit *l,
+                                 struct logfwd *fwd, struct logstream *stream,
+                                 struct crashtail *tail )
+{
+    struct logpipe *lp;
+    int             fd = fcntl( shm->evfd, F_DUPFD_CLOEXEC, 0 );
+
+    if( fd < 0 ) return NULL;
+    if( ( lp = add( p, fd, shm, f, l, fwd, stream, tail ) ) == NULL ) close( fd );
+    return lp;
+}
+
+/*
+ * give the pipe back. the pipe is drained, closed and freed by the worker.
+ */
+void logpump_detach( struct logpump *p, struct logpipe *lp )
+{
+    pthread_mutex_lock( &( p->lock ) );
+    lp->detached = 1;
+    if( !lp->queued ) post( lp->worker, lp, CMD_DEL );
+    pthread_mutex_unlock( &( p->lock ) );
+}
+
+/*
+ * new live subscriber. returns the read end of its pipe, -1 on error.
+ *   queue : pipe size, the most it can lag behind.
+ */
+int logpump_subscribe( struct logpump *p, int queue )
+{
+    struct logsub *s;
+    int            fds[2];
+
+    s = calloc( sizeof( struct logsub ), 1 );
+    if( s == NULL ) return -1;
+    if( pipe2( fds, O_CLOEXEC ) < 0 )
+    {
+        free( s );
+        return -1;
+    }
+    fcntl( fds[1], F_SETFL, fcntl( fds[1], F_GETFL ) | O_NONBLOCK );
+    fcntl( fds[1], F_SETPIPE_SZ, queue ); // default size, if over the limit.
+    s->fd = fds[1];
+
+    pthread_mutex_lock( &( p->sublock ) );
+    s->next = p->subs;
+    p->subs = s;
+    __atomic_add_fetch( &( p->nsubs ), 1, __ATOMIC_RELAXED );
+    pthread_mutex_unlock( &( p->sublock ) );
+    return fds[0];
+}
+
+/*
+ * preallocate n pipes, so that logpump_add() doesn't malloc.
+ * returns -1 if out of memory.
+ */
+int logpump_reserve( struct logpump *p, int n )
+{
+    struct logpipe *lp;
+
+    pthread_mutex_lock( &( p->lock ) );
+    p->keep = n;
+    while( p->nspare < n && ( lp = calloc( sizeof( struct logpipe ), 1 ) ) != NULL )
+    {
+        lp->next = p->spare;
+        p->spare = lp;
+        p->nspare ++;
+    }
+    pthread_mutex_unlock( &( p->lock ) );
+    return ( p->nspare < n ) ? -1 : 0;
+}
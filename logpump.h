@@ -0,0 +1,179 @@
+/*
+ * logpump.h : multi-threaded log pump for watcher.
+ *
+ *  N worker threads, each owns a shard of the child pipes with its own
+ *  epoll instance and writer buffer. a worker reads one buffer per ready
+ *  pipe per round, so a noisy pipe can't starve the others.
+ *  once a second, the hottest pipe of the busiest worker is moved to the
+ *  idlest worker if it makes the shards more even.
+ *
+ *  the output goes to the log file and / or the forwarder ( logfwd ).
+ *
+ *  pipes are handed over by logpump_add(), and given back by
+ *  logpump_detach() ( drained, closed and freed by the worker ).
+ *
+ *  the output of an instance to the log file may be rate limited
+ *  ( bytes / sec and lines / sec, struct loglimit ), shared by all its
+ *  pipes. output over the limit is drained and discarded by line, and
+ *  one summary record with the name of the instance is written when the
+ *  limit clears.
+ *
+ *  the output may also be kept in a crash tail ring ( crashtail.h ),
+ *  which is told when the pipe is drained. a dump that is due is told
+ *  to the owner by the eventfd notify.
+ *
+ *  live subscribers ( logpump_subscribe() ) get a pipe of their own.
+ *  the output is tee()d into it before read, and a subscriber whose
+ *  pipe is full is dropped.
+ *
+ *  with io_uring ( if the kernel has it ), a worker keeps a multishot
+ *  read on each pipe into a ring of provided buffers, and gets the data
+ *  with the completions, all in one io_uring_enter() a round. the data
+ *  is already read then, so subscribers get a copy by write().
+ *
+ *  a shared memory ring of a child ( shmlog.h ) is pumped like a pipe,
+ *  waiting on its eventfd. the data is written from the ring, no read().
+ */
+#ifndef __WATCHER_LOGPUMP_H__
+#define __WATCHER_LOGPUMP_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "placement.h"
+#include "rate.h"
+#include "logfwd.h"
+#include "crashtail.h"
+#include "uring.h"
+#include "shmlog.h"
+
+#define LOGPUMP_BUFSIZ     65536
+#define LOGPUMP_MAXWORKERS 64
+#define LOGPUMP_BALANCE    1000000000LL /* rebalance interval, nsec */
+#define LOGPUMP_STACK      ( 256 * 1024 ) /* of threads, small to be locked */
+#define LOGPUMP_URING_DEPTH  256         /* submission queue */
+#define LOGPUMP_URING_BUFS   32          /* provided buffers of a worker */
+#define LOGPUMP_URING_BUFSIZ LOGPUMP_BUFSIZ
+
+struct logfile {
+    char            *name;
+    int              fd;
+    struct stat      st;
+    int64_t          checked;   /* last rotation check, CLOCK_MONOTONIC nsec */
+    pthread_mutex_t  lock;
+    struct {
+        uint64_t     bytes;     /* written */
+    } stat;
+};
+
+struct loglimit {
+    char            *name;      /* of the instance */
+    pthread_mutex_t  lock;
+    struct rate_bucket bytes;   /* disabled if rate is 0 */
+    struct rate_bucket lines;
+    int64_t          since;     /* suppressing since, 0 if not */
+    int64_t          noticed;   /* last syslog of throttling */
+    uint64_t         sbytes;    /* suppressed in this period */
+    uint64_t         slines;
+    struct {
+        uint64_t     sbytes;    /* suppressed */
+        uint64_t     slines;
+        int          periods;   /* times throttled */
+    } stat;
+};
+
+struct logworker;
+
+struct logpipe {
+    struct logpipe   *next;     /* list of the pump */
+    struct logpipe   *cmdnext;  /* command queue of the worker */
+    int               fd;
+    struct logfile   *file;     /* or NULL */
+    struct loglimit  *limit;    /* of file, or NULL */
+    struct logfwd    *fwd;      /* or NULL */
+    struct logstream *stream;   /* of fwd */
+    struct crashtail *tail;     /* or NULL */
+    struct shmlog    *shm;      /* or NULL, fd is its eventfd */
+    struct logworker *worker;   /* owner */
+    struct logworker *target;   /* move to */
+    int               op;       /* queued command */
+    int               queued;
+    int               detached;
+    int               eof;
+    int               armed;    /* read ( 1 ) or poll ( 2 ) in flight, io_uring */
+    int               cancel;   /* cancel in flight */
+    int               deferred; /* command waiting for the read to end */
+    int               parked;   /* waiting for an sqe, PARK_* */
+    struct logpipe   *parknext;
+    uint64_t          bytes;    /* written by the owner */
+    uint64_t          mark;     /* bytes at the last rebalance */
+    uint64_t          load;     /* bytes in the last period */
+};
+
+struct logsub {
+    struct logsub    *next;
+    int               fd;       /* write end */
+};
+
+struct logworker {
+    struct logpump   *pump;
+    int               id;
+    pthread_t         thread;
+    int               epfd;
+    int               evfd;     /* command wakeup */
+    int               npipes;
+    uint64_t          load;     /* bytes in the last period */
+    struct logpipe   *cmds;
+    struct logpipe  **cmdtail;
+    char             *buff;     /* writer buffer */
+    struct uring     *ring;     /* NULL : epoll */
+    struct logpipe   *parked;   /* no sqe for them, io_uring */
+    int               wake;     /* no sqe for the command wakeup */
+    int               failing;  /* the last wait failed, logged once */
+    uint64_t          waits;    /* epoll_wait() or io_uring_enter() */
+    uint64_t          reads;    /* read() */
+    uint64_t          chunks;   /* of data, each is written once */
+};
+
+struct logpump {
+    int               nworkers;
+    int               debug;
+    int               stop;
+    int               notify;   /* eventfd, a crash tail is due */
+    int               pinned;
+    int               uring;    /* workers on io_uring */
+    int               multishot; /* multishot read, linux 6.7 */
+    struct cpumask    pin;      /* cpus of workers */
+    int64_t           balanced; /* last rebalance */
+    pthread_mutex_t   lock;     /* pipes, command queues */
+    struct logpipe   *pipes;
+    struct logpipe   *spare;    /* freed pipes kept for reuse */
+    int               nspare;
+    int               keep;     /* spares to keep, logpump_reserve() */
+    pthread_mutex_t   sublock;  /* subs */
+    struct logsub    *subs;
+    int               nsubs;
+    uint64_t          dropped;  /* slow subscribers */
+    struct logworker  workers[1];
+};
+
+struct logfile *logfile_new( const char *name );
+struct loglimit *loglimit_new( const char *name, double bytes, double bburst, double lines, double lburst );
+int  writelog( struct logfile *f, struct loglimit *l, const char *buff, int siz );
+void loglimit_idle( struct loglimit *l, struct logfile *f );
+
+struct logpump *logpump_start( int nworkers, int debug, const struct cpumask *pin, int uring );
+void logpump_stop( struct logpump *p );
+struct logpipe *logpump_add( struct logpump *p, int fd, struct logfile *f, struct loglimit *l,
+                             struct logfwd *fwd, struct logstream *stream,
+                             struct crashtail *tail );
+struct logpipe *logpump_add_shm( struct logpump *p, struct shmlog *shm, struct logfile *f, struct loglimit *l,
+                                 struct logfwd *fwd, struct logstream *stream,
+                                 struct crashtail *tail );
+void logpump_detach( struct logpump *p, struct logpipe *lp );
+int  logpump_subscribe( struct logpump *p, int queue );
+int  logpump_reserve( struct logpump *p, int n );
+#define logpump_bytes( LP )  __atomic_load_n( &( ( LP )->bytes ), __ATOMIC_RELAXED )
+
+#endif /* __WATCHER_LOGPUMP_H__ */
@@ -0,0 +1,87 @@
+/*
+ * logtap.c : live log tail for watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#define _GNU_SOURCE
+#include "logtap.h"
+#include "logpump.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*
+ * listening unix socket, -1 on error. a stale socket file is replaced.
+ */
+int logtap_open( const char *path )
+{
+    struct sockaddr_un sun;
+    int                fd;
+
+    if( logtap_addr( &sun, path ) < 0 ) return -1;
+
+    fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if( fd < 0 ) return -1;
+
+    unlink( path );
+    if( bind( fd, (struct sockaddr *)&sun, sizeof( sun ) ) < 0
+     || chmod( path, 0660 ) < 0
+     || listen( fd, 16 ) < 0 )
+    {
+        int e = errno;
+
+        close( fd );
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * accept the subscribers waiting, and hand them their pipe.
+ */
+void logtap_accept( int fd, struct logpump *p )
+{
+    struct msghdr    msg;
+    struct iovec     iov;
+    struct cmsghdr  *cm;
+    char             cbuff[ CMSG_SPACE( sizeof( int ) ) ];
+    char             one = '\0';
+    int              conn, rfd;
+
+    while( ( conn = accept4( fd, NULL, NULL, SOCK_CLOEXEC ) ) >= 0 )
+    {
+        rfd = logpump_subscribe( p, LOGTAP_QUEUE );
+        if( rfd < 0 )
+        {
+            close( conn );
+            continue;
+        }
+        memset( &msg, 0x00, sizeof( msg ) );
+        iov.iov_base       = &one;
+        iov.iov_len        = 1;
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = cbuff;
+        msg.msg_controllen = sizeof( cbuff );
+        cm = CMSG_FIRSTHDR( &msg );
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type  = SCM_RIGHTS;
+        cm->cmsg_len   = CMSG_LEN( sizeof( int ) );
+        memcpy( CMSG_DATA( cm ), &rfd, sizeof( int ) );
+
+        // if not delivered, the pump drops it on the next write ( EPIPE ).
+        sendmsg( conn, &msg, MSG_NOSIGNAL | MSG_DONTWAIT );
+        close( rfd );
+        close( conn );
+    }
+}
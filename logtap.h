@@ -0,0 +1,26 @@
+/*
+ * logtap.h : live log tail for watcher.
+ *
+ *  subscribers connect to a local unix socket and get the read end of a
+ *  pipe ( SCM_RIGHTS ). the log pump tee()s the output of the children
+ *  into the pipe, so no copy per subscriber in watcher.
+ *  the pipe is the bounded queue, a subscriber which can't keep up is
+ *  dropped ( its pipe is closed ) instead of slowing the pump.
+ */
+#ifndef __WATCHER_LOGTAP_H__
+#define __WATCHER_LOGTAP_H__
+
+#define LOGTAP_QUEUE  ( 1024 * 1024 ) /* pipe size of a subscriber */
+
+struct logpump;
+struct sockaddr_un;
+
+/* watcher side, logtap.c */
+int  logtap_open( const char *path );
+void logtap_accept( int fd, struct logpump *p );
+
+/* subscriber side, logtapc.c */
+int  logtap_addr( struct sockaddr_un *sun, const char *path );
+int  logtap_connect( const char *path );
+
+#endif /* __WATCHER_LOGTAP_H__ */
@@ -0,0 +1,76 @@
+/*
+ * logtapc.c : live log tail for watcher, the subscriber side.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#define _GNU_SOURCE /* MSG_CMSG_CLOEXEC */
+#include "logtap.h"
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * the address of path, -1 if too long.
+ */
+int logtap_addr( struct sockaddr_un *sun, const char *path )
+{
+    memset( sun, 0x00, sizeof( *sun ) );
+    if( strlen( path ) >= sizeof( sun->sun_path ) )
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    sun->sun_family = AF_UNIX;
+    strcpy( sun->sun_path, path );
+    return 0;
+}
+
+/*
+ * subscriber side : the read end of the pipe, -1 on error.
+ */
+int logtap_connect( const char *path )
+{
+    struct sockaddr_un sun;
+    struct msghdr      msg;
+    struct iovec       iov;
+    struct cmsghdr    *cm;
+    char               cbuff[ CMSG_SPACE( sizeof( int ) ) ];
+    char               one;
+    int                fd, rfd = -1;
+
+    if( logtap_addr( &sun, path ) < 0 ) return -1;
+
+    fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( fd < 0 ) return -1;
+    if( connect( fd, (struct sockaddr *)&sun, sizeof( sun ) ) < 0 )
+    {
+        int e = errno;
+
+        close( fd );
+        errno = e;
+        return -1;
+    }
+
+    memset( &msg, 0x00, sizeof( msg ) );
+    iov.iov_base       = &one;
+    iov.iov_len        = 1;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuff;
+    msg.msg_controllen = sizeof( cbuff );
+    if( recvmsg( fd, &msg, MSG_CMSG_CLOEXEC ) > 0
+     && ( cm = CMSG_FIRSTHDR( &msg ) ) != NULL
+     && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS )
+        memcpy( &rfd, CMSG_DATA( cm ), sizeof( int ) );
+    else
+        errno = EPROTO;
+    close( fd );
+    return rfd;
+}
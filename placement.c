@@ -0,0 +1,368 @@
+/*
+ * placement.c : CPU / NUMA / scheduler placement of the child.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#define _GNU_SOURCE
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define IOPRIO_CLASS_SHIFT   13
+#define IOPRIO_WHO_PROCESS   1
+
+/*
+ * "0-3,8,10-11" -> mask. returns the number of cpus, -1 if broken.
+ */
+int cpumask_parse( struct cpumask *m, const char *list )
+{
+    const char *p = list;
+    char       *q;
+    long        from, to;
+
+    memset( m, 0x00, sizeof( *m ) );
+    while( *p != '\0' && *p != '\n' )
+    {
+        from = strtol( p, &q, 10 );
+        if( q == p || from < 0 ) return -1;
+        to = from;
+        if( *q == '-' )
+        {
+            p  = q + 1;
+            to = strtol( p, &q, 10 );
+            if( q == p || to < from ) return -1;
+        }
+        if( to >= PLACE_MAXCPU ) return -1;
+        for( ; from <= to ; from ++ ) cpumask_set( m, from );
+
+        if( *q == ',' ) q ++;
+        else if( *q != '\0' && *q != '\n' ) return -1;
+        p = q;
+    }
+    return cpumask_count( m );
+}
+
+int cpumask_count( const struct cpumask *m )
+{
+    int i, n = 0;
+
+    for( i = 0 ; i < PLACE_MAXCPU / PLACE_WORDBITS ; i ++ )
+        n += __builtin_popcountl( m->bits[i] );
+    return n;
+}
+
+/*
+ * n-th set bit, -1 if not exist.
+ */
+int cpumask_nth( const struct cpumask *m, int n )
+{
+    int c;
+
+    for( c = 0 ; c < PLACE_MAXCPU ; c ++ )
+    {
+        if( cpumask_isset( m, c ) && n-- == 0 ) return c;
+    }
+    return -1;
+}
+
+/*
+ * private method: decimal of v at p, the length. no stdio after fork().
+ */
+static int fmtint( char *p, int v )
+{
+    char         buff[12];
+    unsigned int u = ( v < 0 ) ? - (unsigned int)v : (unsigned int)v;
+    int          i = 0, len = 0;
+
+    do{
+        buff[i++] = '0' + u % 10;
+        u /= 10;
+    }while( u > 0 );
+    if( v < 0 ) p[len++] = '-';
+    while( i > 0 ) p[len++] = buff[--i];
+    p[len] = '\0';
+    return len;
+}
+
+static int read_mask( struct cpumask *m, const char *path )
+{
+    char buff[4096];
+    int  fd, siz;
+
+    fd = open( path, O_RDONLY );
+    if( fd < 0 ) return -1;
+
+    siz = read( fd, buff, sizeof( buff ) -1 );
+    close( fd );
+    if( siz <= 0 ) return -1;
+
+    buff[siz] = '\0';
+    return cpumask_parse( m, buff );
+}
+
+/*
+ * option parsers. 0 if OK, -1 if the argument is broken.
+ */
+int placement_cpus( struct placement *pl, const char *arg )
+{
+    pl->flags &= ~( PLACE_CPUS | PLACE_SPREAD | PLACE_NODES );
+    memset( &( pl->cpus ), 0x00, sizeof( pl->cpus ) );
+
+    if( strcmp( arg, "nodes" ) == 0 )
+    {
+        pl->flags |= PLACE_NODES;
+        return 0;
+    }
+    if( strncmp( arg, "spread", 6 ) == 0 )
+    {
+        pl->flags |= PLACE_SPREAD;
+        if( arg[6] == '\0' ) return 0; // all cpus of watcher
+        if( arg[6] != ':' ) return -1;
+
+        arg += 7;
+    }
+    if( cpumask_parse( &( pl->cpus ), arg ) <= 0 ) return -1;
+
+    pl->flags |= PLACE_CPUS;
+    return 0;
+}
+
+int placement_mempolicy( struct placement *pl, const char *arg )
+{
+    const char *p = strchr( arg, ':' );
+    int         len = ( p == NULL ) ? strlen( arg ) : p - arg;
+
+    if( len == 0 ) return -1; // "" is a prefix of any name
+    if(      strncmp( arg, "bind",       len ) == 0 ) pl->mempolicy = MPOL_BIND;
+    else if( strncmp( arg, "interleave", len ) == 0 ) pl->mempolicy = MPOL_INTERLEAVE;
+    else if( strncmp( arg, "preferred",  len ) == 0 ) pl->mempolicy = MPOL_PREFERRED;
+    else if( strncmp( arg, "local",      len ) == 0 ) pl->mempolicy = MPOL_LOCAL;
+    else return -1;
+
+    memset( &( pl->nodes ), 0x00, sizeof( pl->nodes ) );
+    if( pl->mempolicy != MPOL_LOCAL )
+    {
+        if( p == NULL || cpumask_parse( &( pl->nodes ), p+1 ) <= 0 ) return -1;
+    }
+    pl->flags |= PLACE_MEMPOLICY;
+    return 0;
+}
+
+int placement_sched( struct placement *pl, const char *arg )
+{
+    const char *p = strchr( arg, ':' );
+    int         len = ( p == NULL ) ? strlen( arg ) : p - arg;
+
+    if( len == 0 ) return -1;
+    if(      strncmp( arg, "other", len ) == 0 ) pl->policy = SCHED_OTHER;
+    else if( strncmp( arg, "batch", len ) == 0 ) pl->policy = SCHED_BATCH;
+    else if( strncmp( arg, "idle",  len ) == 0 ) pl->policy = SCHED_IDLE;
+    else if( strncmp( arg, "fifo",  len ) == 0 ) pl->policy = SCHED_FIFO;
+    else if( strncmp( arg, "rr",    len ) == 0 ) pl->policy = SCHED_RR;
+    else return -1;
+
+    pl->priority = ( p == NULL ) ? 0 : atoi( p+1 );
+    if( ( pl->policy == SCHED_FIFO || pl->policy == SCHED_RR ) )
+    {
+        if( pl->priority < sched_get_priority_min( pl->policy )
+         || pl->priority > sched_get_priority_max( pl->policy ) ) return -1;
+    }
+    else
+    {
+        pl->priority = 0;
+    }
+    pl->flags |= PLACE_SCHED;
+    return 0;
+}
+
+int placement_ioprio( struct placement *pl, const char *arg )
+{
+    const char *p = strchr( arg, ':' );
+    int         len = ( p == NULL ) ? strlen( arg ) : p - arg;
+
+    if( len == 0 ) return -1;
+    if(      strncmp( arg, "rt",   len ) == 0 ) pl->ioclass = 1;
+    else if( strncmp( arg, "be",   len ) == 0 ) pl->ioclass = 2;
+    else if( strncmp( arg, "idle", len ) == 0 ) pl->ioclass = 3;
+    else return -1;
+
+    pl->iolevel = ( p == NULL ) ? 4 : atoi( p+1 );
+    if( pl->iolevel < 0 || pl->iolevel > 7 ) return -1;
+    if( pl->ioclass == 3 ) pl->iolevel = 0;
+
+    pl->flags |= PLACE_IOPRIO;
+    return 0;
+}
+
+static int set_affinity( const struct cpumask *m )
+{
+    cpu_set_t set;
+    int       c;
+
+    CPU_ZERO( &set );
+    for( c = 0 ; c < PLACE_MAXCPU && c < CPU_SETSIZE ; c ++ )
+    {
+        if( cpumask_isset( m, c ) ) CPU_SET( c, &set );
+    }
+    return sched_setaffinity( 0, sizeof( set ), &set );
+}
+
+static int get_affinity( struct cpumask *m )
+{
+    cpu_set_t set;
+    int       c;
+
+    memset( m, 0x00, sizeof( *m ) );
+    if( sched_getaffinity( 0, sizeof( set ), &set ) < 0 ) return -1;
+
+    for( c = 0 ; c < PLACE_MAXCPU && c < CPU_SETSIZE ; c ++ )
+    {
+        if( CPU_ISSET( c, &set ) ) cpumask_set( m, c );
+    }
+    return 0;
+}
+
+static int set_mempolicy_nodes( int mode, const struct cpumask *nodes )
+{
+    return syscall( SYS_set_mempolicy, mode,
+                    mode == MPOL_LOCAL ? NULL : nodes->bits,
+                    mode == MPOL_LOCAL ? 0 : PLACE_MAXCPU );
+}
+
+/*
+ * private method: cpus and memory of the instance-th NUMA node.
+ */
+static int node_of_instance( int instance, struct cpumask *cpus, struct cpumask *node )
+{
+    struct cpumask online;
+    char           path[128];
+    int            n, id, len;
+
+    if( read_mask( &online, "/sys/devices/system/node/online" ) <= 0 )
+    {
+        memset( &online, 0x00, sizeof( online ) );
+        cpumask_set( &online, 0 ); // no NUMA, single node.
+    }
+    n  = cpumask_count( &online );
+    id = cpumask_nth( &online, instance % n );
+
+    len  = strlen( strcpy( path, "/sys/devices/system/node/node" ) );
+    len += fmtint( path + len, id );
+    strcpy( path + len, "/cpulist" );
+    if( read_mask( cpus, path ) <= 0 && get_affinity( cpus ) < 0 ) return -1;
+
+    memset( node, 0x00, sizeof( *node ) );
+    cpumask_set( node, id );
+    return id;
+}
+
+/*
+ * apply to the calling process. instance is 0 origin.
+ * on error, returns -1 and the failed step in *step ( the rest is applied ).
+ * no stdio and no malloc, it runs in the child between fork() and exec.
+ */
+int placement_apply( const struct placement *pl, int instance, int *step )
+{
+    struct cpumask cpus, node;
+    int            ret = 0;
+
+#define FAIL( S )  do{ if( ret == 0 ) *step = ( S ); ret = -1; }while(0)
+
+    if( pl->flags & PLACE_NODES )
+    {
+        if( node_of_instance( instance, &cpus, &node ) < 0 || set_affinity( &cpus ) < 0 )
+            FAIL( PLACE_FAIL_NODE );
+        if( !( pl->flags & PLACE_MEMPOLICY ) && set_mempolicy_nodes( MPOL_PREFERRED, &node ) < 0 )
+            FAIL( PLACE_FAIL_NODEMEM );
+    }
+    else if( pl->flags & PLACE_SPREAD )
+    {
+        if( pl->flags & PLACE_CPUS )
+            cpus = pl->cpus;
+        else if( get_affinity( &cpus ) < 0 )
+            FAIL( PLACE_FAIL_CPUS );
+
+        if( cpumask_count( &cpus ) > 0 )
+        {
+            int c = cpumask_nth( &cpus, instance % cpumask_count( &cpus ) );
+
+            memset( &cpus, 0x00, sizeof( cpus ) );
+            cpumask_set( &cpus, c );
+            if( set_affinity( &cpus ) < 0 ) FAIL( PLACE_FAIL_CPUS );
+        }
+    }
+    else if( pl->flags & PLACE_CPUS )
+    {
+        if( set_affinity( &( pl->cpus ) ) < 0 ) FAIL( PLACE_FAIL_CPUS );
+    }
+
+    if( pl->flags & PLACE_MEMPOLICY )
+    {
+        if( set_mempolicy_nodes( pl->mempolicy, &( pl->nodes ) ) < 0 ) FAIL( PLACE_FAIL_MEMPOLICY );
+    }
+    if( pl->flags & PLACE_SCHED )
+    {
+        struct sched_param sp;
+
+        memset( &sp, 0x00, sizeof( sp ) );
+        sp.sched_priority = pl->priority;
+        if( sched_setscheduler( 0, pl->policy, &sp ) < 0 ) FAIL( PLACE_FAIL_SCHED );
+    }
+    if( pl->flags & PLACE_NICE )
+    {
+        if( setpriority( PRIO_PROCESS, 0, pl->nice ) < 0 ) FAIL( PLACE_FAIL_NICE );
+    }
+    if( pl->flags & PLACE_IOPRIO )
+    {
+        if( syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                     ( pl->ioclass << IOPRIO_CLASS_SHIFT ) | pl->iolevel ) < 0 )
+            FAIL( PLACE_FAIL_IOPRIO );
+    }
+    if( pl->flags & PLACE_OOMADJ )
+    {
+        char buff[32];
+        int  fd  = open( "/proc/self/oom_score_adj", O_WRONLY );
+        int  len = fmtint( buff, pl->oomadj );
+
+        buff[len ++] = '\n';
+        if( fd < 0 || write( fd, buff, len ) < 0 ) FAIL( PLACE_FAIL_OOMADJ );
+        if( fd >= 0 ) close( fd );
+    }
+#undef FAIL
+    return ret;
+}
+
+/*
+ * name of a failed step.
+ */
+const char *placement_step( int step )
+{
+    static const char *names[] = { "placement", "node affinity", "node memory policy",
+                                   "cpu affinity", "memory policy", "scheduler", "nice",
+                                   "ionice", "oom_score_adj" };
+
+    if( step < 0 || step >= (int)( sizeof( names ) / sizeof( names[0] ) ) ) step = 0;
+    return names[step];
+}
+
+/*
+ * pin the calling thread.
+ */
+int placement_pin_self( const struct cpumask *m )
+{
+    return set_affinity( m );
+}
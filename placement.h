@@ -0,0 +1,73 @@
+/*
+ * placement.h : CPU / NUMA / scheduler placement of the child.
+ *
+ *  applied between fork() and execv(), while still privileged.
+ *
+ *   -c list        : CPU affinity, e.g. "0-3,8".
+ *   -c spread[:list] : one core per instance, round robin in list.
+ *   -c nodes       : one NUMA node per instance ( cpus and memory ).
+ *   -m policy[:nodes] : NUMA memory policy, bind / interleave / preferred / local.
+ *   -S policy[:prio]  : scheduling policy, other / batch / idle / fifo / rr.
+ *   -N #           : nice.
+ *   -i class[:#]   : I/O priority, rt / be / idle.
+ *   -o #           : oom_score_adj.
+ */
+#ifndef __WATCHER_PLACEMENT_H__
+#define __WATCHER_PLACEMENT_H__
+
+#define PLACE_MAXCPU   1024
+#define PLACE_WORDBITS ( 8 * sizeof( unsigned long ) )
+
+/* flags */
+#define PLACE_CPUS      0x0001
+#define PLACE_SPREAD    0x0002  /* one cpu per instance */
+#define PLACE_NODES     0x0004  /* one NUMA node per instance */
+#define PLACE_MEMPOLICY 0x0008
+#define PLACE_SCHED     0x0010
+#define PLACE_NICE      0x0020
+#define PLACE_IOPRIO    0x0040
+#define PLACE_OOMADJ    0x0080
+
+struct cpumask {
+    unsigned long bits[ PLACE_MAXCPU / PLACE_WORDBITS ];
+};
+
+struct placement {
+    int            flags;
+    struct cpumask cpus;
+    int            mempolicy;
+    struct cpumask nodes;
+    int            policy;
+    int            priority;
+    int            nice;
+    int            ioclass;
+    int            iolevel;
+    int            oomadj;
+};
+
+int  cpumask_parse( struct cpumask *m, const char *list );
+int  cpumask_count( const struct cpumask *m );
+int  cpumask_nth( const struct cpumask *m, int n );
+#define cpumask_set( M, C )    ( ( M )->bits[ ( C ) / PLACE_WORDBITS ] |= 1UL << ( ( C ) % PLACE_WORDBITS ) )
+#define cpumask_isset( M, C )  ( ( ( M )->bits[ ( C ) / PLACE_WORDBITS ] >> ( ( C ) % PLACE_WORDBITS ) ) & 1 )
+
+int  placement_cpus( struct placement *pl, const char *arg );
+int  placement_mempolicy( struct placement *pl, const char *arg );
+int  placement_sched( struct placement *pl, const char *arg );
+int  placement_ioprio( struct placement *pl, const char *arg );
+
+/* failed step of placement_apply(), named by placement_step() */
+#define PLACE_FAIL_NODE      1
+#define PLACE_FAIL_NODEMEM   2
+#define PLACE_FAIL_CPUS      3
+#define PLACE_FAIL_MEMPOLICY 4
+#define PLACE_FAIL_SCHED     5
+#define PLACE_FAIL_NICE      6
+#define PLACE_FAIL_IOPRIO    7
+#define PLACE_FAIL_OOMADJ    8
+
+int  placement_apply( const struct placement *pl, int instance, int *step );
+const char *placement_step( int step );
+int  placement_pin_self( const struct cpumask *m );
+
+#endif /* __WATCHER_PLACEMENT_H__ */
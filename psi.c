@@ -0,0 +1,225 @@
+/*
+ * psi.c : pressure stall information of the host ( or a cgroup ), -Q.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "psi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+/*
+ * "memory:some:100:1000,io:200" -> triggers. NULL if broken.
+ */
+struct psi *psi_parse( const char *spec )
+{
+    struct psi *p;
+    char       *buff, *item, *tok, *s1, *s2;
+
+    p    = calloc( sizeof( struct psi ), 1 );
+    buff = strdup( spec );
+    if( p == NULL || buff == NULL ) return NULL;
+
+    for( item = strtok_r( buff, ",", &s1 ) ; item != NULL ; item = strtok_r( NULL, ",", &s1 ) )
+    {
+        struct psi_trigger *t = &( p->t[ p->n ] );
+        long   stall, window = PSI_WINDOW;
+        char   path[256];
+
+        if( p->n >= PSI_MAX ) goto broken;
+        if( ( tok = strtok_r( item, ":", &s2 ) ) == NULL ) goto broken;
+
+        if( strchr( tok, '/' ) != NULL )
+            snprintf( path, sizeof( path ), "%s", tok );
+        else if( strcmp( tok, "cpu" ) == 0 || strcmp( tok, "memory" ) == 0 || strcmp( tok, "io" ) == 0 )
+            snprintf( path, sizeof( path ), "/proc/pressure/%s", tok );
+        else
+            goto broken;
+        t->path = strdup( path );
+        t->name = ( strchr( tok, '/' ) != NULL ) ? t->path : strrchr( t->path, '/' ) + 1;
+
+        if( ( tok = strtok_r( NULL, ":", &s2 ) ) == NULL ) goto broken;
+        if( strcmp( tok, "some" ) == 0 || strcmp( tok, "full" ) == 0 )
+        {
+            t->full = ( tok[0] == 'f' );
+            if( ( tok = strtok_r( NULL, ":", &s2 ) ) == NULL ) goto broken;
+        }
+        stall = atol( tok );
+        if( ( tok = strtok_r( NULL, ":", &s2 ) ) != NULL ) window = atol( tok );
+        if( strtok_r( NULL, ":", &s2 ) != NULL ) goto broken;
+
+        // the limits of the kernel for triggers.
+        if( window < 500 || window > 10000 || stall <= 0 || stall > window ) goto broken;
+
+        t->stall  = stall  * 1000000LL;
+        t->window = window * 1000000LL;
+        t->fd     = -1;
+        p->n ++;
+    }
+    free( buff );
+    if( p->n == 0 ) goto broken2;
+    return p;
+
+ broken:
+    free( buff );
+ broken2:
+    free( p );
+    errno = EINVAL;
+    return NULL;
+}
+
+/*
+ * private method: read the "some" or "full" line. -1 on error.
+ */
+static int sample( const struct psi_trigger *t, double *avg10, uint64_t *total )
+{
+    char  buff[256], *line;
+    int   fd, siz;
+    unsigned long long tot;
+
+    fd = open( t->path, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return -1;
+    siz = read( fd, buff, sizeof( buff ) -1 );
+    close( fd );
+    if( siz <= 0 ) return -1;
+    buff[siz] = '\0';
+
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+    line = t->full ? strstr( buff, "full " ) : strstr( buff, "some " );
+    if( line == NULL || sscanf( line + 5, "avg10=%lf avg60=%*f avg300=%*f total=%llu", avg10, &tot ) != 2 )
+        return -1;
+    *total = tot;
+    return 0;
+}
+
+/*
+ * private method: over the threshold since the last sample ?
+ *   from the total stall time, or avg10 if the last sample is too old.
+ */
+static void poll_trigger( struct psi_trigger *t, int64_t now )
+{
+    double   avg10, ratio;
+    uint64_t total;
+
+    if( t->sampled != 0 && now - t->sampled < t->window ) return; // too short to tell.
+    if( sample( t, &avg10, &total ) < 0 ) return ;
+
+    if( t->sampled != 0 && now - t->sampled <= PSI_AVGSPAN && total >= t->total )
+        ratio = ( total - t->total ) * 1000.0 / ( now - t->sampled );
+    else
+        ratio = avg10 / 100.0;
+
+    if( ratio * t->window >= t->stall )
+    {
+        t->high = now + t->window;
+        t->events ++;
+    }
+    t->total   = total;
+    t->sampled = now;
+}
+
+/*
+ * open the files and arm the triggers. returns the number of armed
+ * triggers, -1 if a file can't be read ( *what is the path ).
+ */
+int psi_arm( struct psi *p, int64_t now, const char **what )
+{
+    struct statfs fs;
+    char buff[64];
+    int  i, armed = 0;
+
+    for( i = 0 ; i < p->n ; i ++ )
+    {
+        struct psi_trigger *t = &( p->t[i] );
+
+        if( access( t->path, R_OK ) < 0 )
+        {
+            *what = t->path;
+            return -1;
+        }
+        poll_trigger( t, now ); // the first sample.
+
+        t->fd = open( t->path, O_RDWR | O_NONBLOCK | O_CLOEXEC );
+        if( t->fd < 0 ) continue;
+
+        // triggers are of procfs and cgroup2 only, don't write to others.
+        if( fstatfs( t->fd, &fs ) < 0 || ( fs.f_type != PROC_SUPER_MAGIC && fs.f_type != CGROUP2_SUPER_MAGIC ) )
+        {
+            close( t->fd );
+            t->fd = -1;
+            continue;
+        }
+
+        // "some 150000 1000000", usec. with '\0'.
+        snprintf( buff, sizeof( buff ), "%s %lld %lld", t->full ? "full" : "some",
+                  (long long)( t->stall / 1000 ), (long long)( t->window / 1000 ) );
+        if( write( t->fd, buff, strlen( buff ) + 1 ) < 0 )
+        {
+            close( t->fd );
+            t->fd = -1;
+            continue;
+        }
+        armed ++;
+    }
+    return armed;
+}
+
+/*
+ * an event on fd. 0 if fd is not a trigger.
+ *   the kernel fires at most once a window while over the threshold,
+ *   so the pressure lasts until a window and a half without events.
+ */
+int psi_event( struct psi *p, int fd, unsigned int events, int64_t now )
+{
+    int i;
+
+    for( i = 0 ; i < p->n ; i ++ )
+    {
+        struct psi_trigger *t = &( p->t[i] );
+
+        if( t->fd < 0 || t->fd != fd ) continue;
+
+        if( events & EPOLLERR ) // the cgroup is gone, poll.
+        {
+            close( t->fd );
+            t->fd = -1;
+            return 1;
+        }
+        t->high = now + t->window + t->window / 2;
+        t->events ++;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * 1 if under pressure now, *what is the name of the resource.
+ */
+int psi_pressured( struct psi *p, int64_t now, const char **what )
+{
+    int i;
+
+    for( i = 0 ; i < p->n ; i ++ )
+    {
+        struct psi_trigger *t = &( p->t[i] );
+
+        if( t->fd < 0 ) poll_trigger( t, now );
+        if( t->high > now )
+        {
+            *what = t->name;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * psi.h : pressure stall information of the host ( or a cgroup ), -Q.
+ *
+ *  spec is a comma separated list of
+ *
+ *    resource[:some|full]:stall[:window]
+ *
+ *  resource is cpu, memory, io ( /proc/pressure/ ) or the path of a
+ *  pressure file of a cgroup, e.g. /sys/fs/cgroup/app/memory.pressure.
+ *  the host is under pressure while tasks stall for stall msec or more
+ *  in window msec ( default 1000, 500 to 10000 ). "some" is the default.
+ *
+ *  a PSI trigger is armed on each file and polled in the event loop. if
+ *  the kernel refuses it, the file is read when asked instead.
+ */
+#ifndef __WATCHER_PSI_H__
+#define __WATCHER_PSI_H__
+
+#include <stdint.h>
+
+#define PSI_MAX         8
+#define PSI_WINDOW      1000     /* msec */
+#define PSI_AVGSPAN     ( 10 * 1000000000LL )  /* older sample : use avg10 */
+
+struct psi_trigger {
+    char     *path;
+    const char *name;      /* for messages */
+    int       full;
+    int64_t   stall;       /* nsec */
+    int64_t   window;      /* nsec */
+    int       fd;          /* armed trigger, -1 if polled */
+    uint64_t  total;       /* usec, last sample */
+    int64_t   sampled;     /* CLOCK_MONOTONIC nsec */
+    int64_t   high;        /* under pressure until */
+    unsigned  events;      /* fired */
+};
+
+struct psi {
+    int n;
+    struct psi_trigger t[PSI_MAX];
+};
+
+struct psi *psi_parse( const char *spec );
+int  psi_arm( struct psi *p, int64_t now, const char **what );
+int  psi_event( struct psi *p, int fd, unsigned int events, int64_t now );
+int  psi_pressured( struct psi *p, int64_t now, const char **what );
+
+#endif /* __WATCHER_PSI_H__ */
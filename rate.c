@@ -0,0 +1,142 @@
+/*
+ * rate.c : event rate engines for watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "rate.h"
+#include <stdlib.h>
+#include <math.h>
+
+/*
+ * sliding window, the newest 'count' events.
+ */
+struct rate_window *rate_window_new( int count, int64_t region )
+{
+    struct rate_window *w;
+
+    if( count < 1 ) count = 1;
+
+    w = calloc( sizeof( struct rate_window ) + sizeof( int64_t ) * count, 1 );
+    if( w == NULL ) return NULL;
+
+    w->region  = region;
+    w->count   = count;
+    w->length  = count;
+    w->last    = -1;// little magic
+    w->filled  = 0;
+    return w;
+}
+
+void rate_window_push( struct rate_window *w, int64_t now )
+{
+    w->last = ( w->last + 1 ) % w->length;
+    if( w->filled < w->length ) w->filled ++;
+
+    w->stamps[ w->last ] = now;
+}
+
+/*
+ * prev = 0 is the newest. -1 if not exist.
+ */
+int64_t rate_window_get( const struct rate_window *w, int prev )
+{
+    if( prev < 0 || prev >= w->filled ) return -1;
+
+    return w->stamps[ ( w->last - prev + w->length ) % w->length ];
+}
+
+/*
+ * the newest 'count' events happened in 'region' ?
+ */
+int rate_window_tripped( const struct rate_window *w )
+{
+    if( w->region <= 0 || w->filled < w->count ) return 0;
+
+    return rate_window_get( w, 0 ) - rate_window_get( w, w->count - 1 ) <= w->region;
+}
+
+/*
+ * exponentially weighted moving average.
+ */
+void rate_ewma_init( struct rate_ewma *e, double tau, double limit )
+{
+    e->tau   = tau;
+    e->limit = limit;
+    e->rate  = 0.0;
+    e->last  = 0;
+}
+
+void rate_ewma_push( struct rate_ewma *e, int64_t now )
+{
+    if( e->tau <= 0.0 ) return ;
+
+    e->rate = rate_ewma_rate( e, now ) + 1.0 / e->tau;
+    e->last = now;
+}
+
+double rate_ewma_rate( const struct rate_ewma *e, int64_t now )
+{
+    if( e->tau <= 0.0 || e->rate == 0.0 ) return 0.0;
+
+    return e->rate * exp( - (double)( now - e->last ) / RATE_SEC / e->tau );
+}
+
+int rate_ewma_tripped( const struct rate_ewma *e, int64_t now )
+{
+    if( e->tau <= 0.0 || e->limit <= 0.0 ) return 0;
+
+    return rate_ewma_rate( e, now ) > e->limit;
+}
+
+/*
+ * token bucket.
+ */
+void rate_bucket_init( struct rate_bucket *b, double rate, double burst, int64_t now )
+{
+    b->rate   = rate;
+    b->burst  = ( burst > 0.0 ) ? burst : 1.0;
+    b->tokens = b->burst;
+    b->last   = now;
+}
+
+static double bucket_tokens( const struct rate_bucket *b, int64_t now )
+{
+    double t = b->tokens + (double)( now - b->last ) / RATE_SEC * b->rate;
+
+    return ( t > b->burst ) ? b->burst : t;
+}
+
+/*
+ * take n tokens. 1 if allowed, 0 if the bucket is short.
+ */
+int rate_bucket_take( struct rate_bucket *b, int64_t now, double n )
+{
+    if( b->rate <= 0.0 ) return 1; // disabled
+
+    b->tokens = bucket_tokens( b, now );
+    b->last   = now;
+    if( b->tokens < n ) return 0;
+
+    b->tokens -= n;
+    return 1;
+}
+
+/*
+ * nsec until n tokens are available.
+ */
+int64_t rate_bucket_wait( const struct rate_bucket *b, int64_t now, double n )
+{
+    double t;
+
+    if( b->rate <= 0.0 ) return 0;
+
+    t = bucket_tokens( b, now );
+    if( t >= n ) return 0;
+
+    return (int64_t)( ( n - t ) / b->rate * RATE_SEC ) + 1;
+}
@@ -0,0 +1,56 @@
+/*
+ * rate.h : event rate engines for watcher.
+ *
+ *  all times are CLOCK_MONOTONIC nsec, given by the caller.
+ *
+ *  rate_window : sliding window, "count events in region".
+ *  rate_ewma   : exponentially weighted moving average of event rate.
+ *  rate_bucket : token bucket.
+ *
+ *  update and query are O(1).
+ */
+#ifndef __WATCHER_RATE_H__
+#define __WATCHER_RATE_H__
+
+#include <stdint.h>
+
+#define RATE_SEC  1000000000LL
+
+struct rate_window {
+    int64_t  region;     /* window width, nsec */
+    int      count;      /* threshold */
+    int      length;     /* ring length ( = count ) */
+    int      last;       /* newest slot, -1 if empty */
+    int      filled;     /* valid slots */
+    int64_t  stamps[1];
+};
+
+struct rate_ewma {
+    double   tau;        /* time constant, sec. 0 is disabled */
+    double   limit;      /* threshold, events / sec */
+    double   rate;       /* events / sec at 'last' */
+    int64_t  last;
+};
+
+struct rate_bucket {
+    double   rate;       /* tokens / sec. 0 is disabled */
+    double   burst;      /* bucket size */
+    double   tokens;
+    int64_t  last;
+};
+
+struct rate_window *rate_window_new( int count, int64_t region );
+void    rate_window_push( struct rate_window *w, int64_t now );
+int     rate_window_tripped( const struct rate_window *w );
+int64_t rate_window_get( const struct rate_window *w, int prev );
+
+void    rate_ewma_init( struct rate_ewma *e, double tau, double limit );
+void    rate_ewma_push( struct rate_ewma *e, int64_t now );
+double  rate_ewma_rate( const struct rate_ewma *e, int64_t now );
+int     rate_ewma_tripped( const struct rate_ewma *e, int64_t now );
+
+void    rate_bucket_init( struct rate_bucket *b, double rate, double burst, int64_t now );
+int     rate_bucket_take( struct rate_bucket *b, int64_t now, double n );
+int64_t rate_bucket_wait( const struct rate_bucket *b, int64_t now, double n );
+
+#endif /* __WATCHER_RATE_H__ */
@@ -0,0 +1,105 @@
+/*
+ * shmlog.c : shared memory log channel, watcher side.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#define _GNU_SOURCE /* memfd_create */
+#include "shmlog.h"
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+
+/*
+ * a ring of size bytes ( rounded up ), its memfd and eventfd are
+ * close-on-exec. NULL on error.
+ */
+struct shmlog *shmlog_create( int size )
+{
+    struct shmlog *l;
+    int            memfd, evfd;
+
+    if( size <= 0 || size > SHMLOG_MAXSIZE )
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    size = ( size + SHMLOG_HEAD - 1 ) / SHMLOG_HEAD * SHMLOG_HEAD;
+
+    if( ( memfd = memfd_create( "watcher-shmlog", MFD_CLOEXEC | MFD_ALLOW_SEALING ) ) < 0 )
+        return NULL;
+    if( ( evfd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) < 0 )
+    {
+        close( memfd );
+        return NULL;
+    }
+    // the child can't shrink it under us ( SIGBUS ).
+    if( ftruncate( memfd, SHMLOG_HEAD + (off_t)size ) < 0
+     || fcntl( memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL ) < 0
+     || ( l = calloc( sizeof( struct shmlog ), 1 ) ) == NULL )
+        goto error;
+    if( ( l->h = shmlog_map( memfd, size ) ) == NULL )
+    {
+        free( l );
+        goto error;
+    }
+    l->h->magic    = SHMLOG_MAGIC;
+    l->h->size     = size;
+    l->h->sleeping = 1;
+    l->data  = (char *)l->h + SHMLOG_HEAD;
+    l->size  = size;
+    l->memfd = memfd;
+    l->evfd  = evfd;
+    return l;
+
+ error:
+    close( memfd );
+    close( evfd );
+    return NULL;
+}
+
+/*
+ * what is in the ring, max bytes at most, from *buff.
+ */
+int shmlog_peek( struct shmlog *l, const char **buff, int max )
+{
+    uint64_t tail = __atomic_load_n( &( l->h->tail ), __ATOMIC_ACQUIRE );
+    uint64_t head = l->h->head;
+
+    if( tail - head > l->size ) // broken by the child, skip it.
+    {
+        syslog( LOG_WARNING, "shared memory log is broken ( head %llu, tail %llu ), skipped.",
+                (unsigned long long)head, (unsigned long long)tail );
+        __atomic_store_n( &( l->h->head ), tail, __ATOMIC_RELEASE );
+        return 0;
+    }
+   *buff = l->data + head % l->size;
+    return ( tail - head > (uint64_t)max ) ? max : (int)( tail - head );
+}
+
+/*
+ * siz bytes of peek are written, the child may reuse them.
+ */
+void shmlog_consume( struct shmlog *l, int siz )
+{
+    __atomic_store_n( &( l->h->head ), l->h->head + siz, __ATOMIC_RELEASE );
+}
+
+/*
+ * the ring is empty, the log thread waits for the eventfd. if the child
+ * wrote meanwhile, the eventfd is kept readable.
+ */
+void shmlog_idle( struct shmlog *l )
+{
+    uint64_t cnt, one = 1;
+
+    read( l->evfd, &cnt, sizeof( cnt ) );
+    __atomic_store_n( &( l->h->sleeping ), 1, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &( l->h->tail ), __ATOMIC_SEQ_CST ) != l->h->head
+     && __atomic_exchange_n( &( l->h->sleeping ), 0, __ATOMIC_SEQ_CST ) )
+        write( l->evfd, &one, sizeof( one ) );
+}
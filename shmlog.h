@@ -0,0 +1,165 @@
+/*
+ * shmlog.h : shared memory log channel of a child ( -B ), header only.
+ *
+ *  watcher makes a ring for each instance ( memfd ) and an eventfd, and
+ *  passes both at exec with WATCHER_SHMLOG=memfd,eventfd in the
+ *  environment. a child that knows it appends to the ring with one
+ *  memcpy(), and kicks the eventfd only when the log thread sleeps. the
+ *  log threads write the ring to the log file like the pipes, so there
+ *  is no copy in the kernel. stdout and stderr work as before.
+ *
+ *  the data is mapped twice back to back, a record never wraps.
+ *  single producer : calls of shmlog_write() are serialized by the
+ *  child, and only one process writes the ring. if the ring is full,
+ *  the record is dropped ( counted ) and -1 is returned, the child may
+ *  write it to stdout instead.
+ *
+ *    #include "shmlog.h"
+ *
+ *    struct shmlog *l = shmlog_attach();     // NULL if not under -B
+ *
+ *    if( l == NULL || shmlog_write( l, buff, len ) < 0 )
+ *        write( 1, buff, len );
+ */
+#ifndef __WATCHER_SHMLOG_H__
+#define __WATCHER_SHMLOG_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHMLOG_MAGIC    0x314c4d53 /* "SML1" */
+#define SHMLOG_HEAD     65536      /* header, a page of any size */
+#define SHMLOG_MAXSIZE  ( 1024 * 1024 * 1024 )
+#define SHMLOG_ENV      "WATCHER_SHMLOG"
+
+struct shmlog_head {
+    uint32_t magic;
+    uint32_t size;       /* of data, multiple of SHMLOG_HEAD */
+    /* by the child */
+    uint64_t tail     __attribute__(( aligned( 64 ) )); /* bytes ever written */
+    uint64_t dropped;    /* bytes, the ring was full */
+    /* by watcher */
+    uint64_t head     __attribute__(( aligned( 64 ) )); /* bytes ever read */
+    uint32_t sleeping;   /* the log thread waits for the eventfd */
+};
+
+struct shmlog {
+    struct shmlog_head *h;
+    char     *data;      /* size, and the same size again */
+    uint32_t  size;
+    int       memfd;
+    int       evfd;
+    uint64_t  tail;      /* of the child */
+    int       owned;     /* of watcher, a log thread drains it */
+};
+
+/*
+ * header and the data twice, NULL on error.
+ */
+static inline struct shmlog_head *shmlog_map( int fd, uint32_t size )
+{
+    size_t len  = SHMLOG_HEAD + 2 * (size_t)size;
+    char  *base = mmap( NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if( base == MAP_FAILED ) return NULL;
+    if( mmap( base, SHMLOG_HEAD + (size_t)size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_FIXED, fd, 0 ) == MAP_FAILED
+     || mmap( base + SHMLOG_HEAD + size, size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_FIXED, fd, SHMLOG_HEAD ) == MAP_FAILED )
+    {
+        munmap( base, len );
+        return NULL;
+    }
+    return (struct shmlog_head *)base;
+}
+
+/*
+ * the ring on memfd, woken by evfd. NULL on error.
+ */
+static inline struct shmlog *shmlog_open( int memfd, int evfd )
+{
+    struct shmlog *l;
+    struct stat    stbuf;
+    uint32_t       size;
+
+    if( fstat( memfd, &stbuf ) < 0 ) return NULL;
+    if( stbuf.st_size <= SHMLOG_HEAD || stbuf.st_size > SHMLOG_HEAD + (off_t)SHMLOG_MAXSIZE
+     || ( stbuf.st_size % SHMLOG_HEAD ) != 0 )
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    size = stbuf.st_size - SHMLOG_HEAD;
+    if( ( l = calloc( sizeof( struct shmlog ), 1 ) ) == NULL ) return NULL;
+    if( ( l->h = shmlog_map( memfd, size ) ) == NULL || l->h->magic != SHMLOG_MAGIC || l->h->size != size )
+    {
+        if( l->h != NULL ) munmap( l->h, SHMLOG_HEAD + 2 * (size_t)size );
+        free( l );
+        errno = EINVAL;
+        return NULL;
+    }
+    l->data  = (char *)l->h + SHMLOG_HEAD;
+    l->size  = size;
+    l->memfd = memfd;
+    l->evfd  = evfd;
+    l->tail  = __atomic_load_n( &( l->h->tail ), __ATOMIC_ACQUIRE );
+    return l;
+}
+
+/*
+ * the ring given by watcher, NULL if none.
+ */
+static inline struct shmlog *shmlog_attach( void )
+{
+    const char *env = getenv( SHMLOG_ENV );
+    int         memfd, evfd;
+
+    if( env == NULL || sscanf( env, "%d,%d", &memfd, &evfd ) != 2 ) return NULL;
+    return shmlog_open( memfd, evfd );
+}
+
+/*
+ * append len bytes. len, or -1 if the ring is full.
+ */
+static inline int shmlog_write( struct shmlog *l, const void *buff, int len )
+{
+    uint64_t head = __atomic_load_n( &( l->h->head ), __ATOMIC_ACQUIRE );
+    uint64_t one  = 1;
+
+    if( len <= 0 ) return 0;
+    if( (uint64_t)len > l->size - ( l->tail - head ) )
+    {
+        __atomic_add_fetch( &( l->h->dropped ), len, __ATOMIC_RELAXED );
+        errno = ENOBUFS;
+        return -1;
+    }
+    memcpy( l->data + l->tail % l->size, buff, len );
+    l->tail += len;
+    __atomic_store_n( &( l->h->tail ), l->tail, __ATOMIC_SEQ_CST );
+
+    // the log thread went to sleep, wake it up once.
+    if( __atomic_load_n( &( l->h->sleeping ), __ATOMIC_SEQ_CST )
+     && __atomic_exchange_n( &( l->h->sleeping ), 0, __ATOMIC_SEQ_CST ) )
+        write( l->evfd, &one, sizeof( one ) );
+    return len;
+}
+
+static inline void shmlog_detach( struct shmlog *l )
+{
+    munmap( l->h, SHMLOG_HEAD + 2 * (size_t)l->size );
+    free( l );
+}
+
+/* watcher side, shmlog.c */
+struct shmlog *shmlog_create( int size );
+int  shmlog_peek( struct shmlog *l, const char **buff, int max );
+void shmlog_consume( struct shmlog *l, int siz );
+void shmlog_idle( struct shmlog *l );
+
+#endif /* __WATCHER_SHMLOG_H__ */
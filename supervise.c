@@ -0,0 +1,171 @@
+/*
+ * supervise.c : supervision core of watcher, the crash-loop policy.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "watcher.h"
+#include "supervise.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/wait.h>
+
+static void restart_due( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    struct watcher_state *state = arg;
+
+    state->sv->stat.restarts ++;
+    state->sv->ops->start( state->sv, state );
+}
+
+void supervise_init( struct supervisor *sv, const struct supervisor_ops *ops, void *ctx,
+                     struct twheel *wheel )
+{
+    memset( sv, 0x00, sizeof( *sv ) );
+    sv->ops   = ops;
+    sv->ctx   = ctx;
+    sv->wheel = wheel;
+}
+
+/*
+ * the policy of a new instance, by its config. -1 if out of memory.
+ */
+int supervise_state( struct supervisor *sv, struct watcher_state *state )
+{
+    const struct watcher_conf *config = state->config;
+    int64_t now = sv->ops->now( sv );
+    char    buff[64];
+
+    state->sv     = sv;
+    state->window = NULL;
+    twheel_timer_init( &( state->restart ), restart_due, state );
+
+    if( config->alert.count > 0 && config->alert.region > 0 )
+    {
+        state->window = rate_window_new( config->alert.count,
+                                         config->alert.region * RATE_SEC );
+        if( state->window == NULL ) return -1;
+
+        if( sv->debug )
+        {
+            snprintf( buff, sizeof( buff ), "slot length = %d", state->window->length );
+            sv->ops->log( sv, LOG_DEBUG, buff );
+        }
+    }
+    rate_ewma_init( &( state->ewma ), config->ewma.tau, config->ewma.limit / 60.0 );
+    rate_bucket_init( &( state->bucket ), config->bucket.rate / 60.0, config->bucket.burst, now );
+    return 0;
+}
+
+/*
+ * a crash of the previous watcher, from the journal. oldest first.
+ */
+void supervise_restore( struct watcher_state *state, int64_t when )
+{
+    struct rate_bucket *b = &( state->bucket );
+
+    if( state->window != NULL ) rate_window_push( state->window, when );
+    rate_ewma_push( &( state->ewma ), when );
+
+    // the bucket is full since supervise_state(), it was full at the first
+    // record too. start refilling from there, not from now.
+    if( when < b->last && b->tokens >= b->burst ) b->last = when;
+    rate_bucket_take( b, ( when > b->last ) ? when : b->last, 1.0 );
+}
+
+/*
+ * set crash time
+ */
+void supervise_crashed( struct supervisor *sv, struct watcher_state *state, int64_t now )
+{
+    char buff[128];
+
+    if( state->window != NULL ) rate_window_push( state->window, now );
+    rate_ewma_push( &( state->ewma ), now );
+    if( !sv->debug ) return ;
+
+    snprintf( buff, sizeof( buff ), "set crash -> %lld.%09lld, ewma %.3f/min",
+              (long long)( now / RATE_SEC ), (long long)( now % RATE_SEC ),
+              rate_ewma_rate( &( state->ewma ), now ) * 60.0 );
+    sv->ops->log( sv, LOG_DEBUG, buff );
+}
+
+/*
+ * -1 if the instance should sleep before the restart.
+ */
+int supervise_check( struct supervisor *sv, struct watcher_state *state, int64_t now )
+{
+    char    buff[128];
+    int64_t c,p;
+
+    if( state->window != NULL && rate_window_tripped( state->window ) )
+    {
+        c =  rate_window_get( state->window, 0 /*current*/ );
+        p =  rate_window_get( state->window, state->window->count - 1 );
+        snprintf( buff, sizeof( buff ), "process down %d times in %.3f sec, sleeping.",
+                  state->window->count, ( c - p ) / 1e9 );
+        sv->ops->log( sv, LOG_ERR, buff );
+        sv->stat.window ++;
+        return -1; /* problem? */
+    }
+    if( rate_ewma_tripped( &( state->ewma ), now ) )
+    {
+        snprintf( buff, sizeof( buff ), "process down %.2f times/min, sleeping.",
+                  rate_ewma_rate( &( state->ewma ), now ) * 60.0 );
+        sv->ops->log( sv, LOG_ERR, buff );
+        sv->stat.ewma ++;
+        return -1; /* problem? */
+    }
+    if( !rate_bucket_take( &( state->bucket ), now, 1.0 ) )
+    {
+        sv->ops->log( sv, LOG_ERR, "restart budget exhausted, sleeping." );
+        sv->stat.bucket ++;
+        return -1; /* problem? */
+    }
+    if( state->execfail )
+    {
+        return -1;
+    }
+    if( WEXITSTATUS( state->wstatus ) != 0)
+    {
+        snprintf( buff, sizeof( buff ), "process abnormal terminate, status = %d.",
+                  WEXITSTATUS( state->wstatus ) );
+        sv->ops->log( sv, LOG_ERR, buff );
+        return 0; /* problem? */
+    }
+
+    return 0;// no-problem
+}
+
+/*
+ * the instance terminated ( state->wstatus ), schedule the restart.
+ * returns 1 if it sleeps.
+ */
+int supervise_exited( struct supervisor *sv, struct watcher_state *state )
+{
+    const struct watcher_conf *config = state->config;
+    int64_t now   = sv->ops->now( sv );
+    int64_t delay = RESTART_DELAY;
+    int     slept = 0;
+
+    sv->stat.exits ++;
+    if( WIFSIGNALED( state->wstatus ) || WEXITSTATUS( state->wstatus ) != 0 ) sv->stat.abnormal ++;
+    if( !state->execfail ) state->execerr = 0; // it ran.
+
+    supervise_crashed( sv, state, now );
+    if( supervise_check( sv, state, now ) )
+    {
+        delay += config->sleeptime * RATE_SEC;
+        slept  = 1;
+    }
+    state->execfail = 0;
+    state->due = now + delay;
+    twheel_add( sv->wheel, &( state->restart ), state->due );
+    return slept;
+}
@@ -0,0 +1,51 @@
+/*
+ * supervise.h : supervision core of watcher, the crash-loop policy.
+ *
+ *  an exit of an instance is counted in its crash window ( -t ), average
+ *  crash rate ( -e ) and restart budget ( -b ), and the restart is put
+ *  on the timer wheel : RESTART_DELAY later, plus the sleep time ( -s )
+ *  if one of them tripped. when it is due, the owner starts it.
+ *
+ *  the clock, the start of a process and the log come through struct
+ *  supervisor_ops, so the same policy runs in watcher ( CLOCK_MONOTONIC,
+ *  fork() and exec ) and in wsim ( a virtual clock, synthetic children ).
+ */
+#ifndef __WATCHER_SUPERVISE_H__
+#define __WATCHER_SUPERVISE_H__
+
+#include <stdint.h>
+
+struct supervisor;
+struct watcher_state;
+struct twheel;
+
+struct supervisor_ops {
+    int64_t (*now)( struct supervisor *sv );   /* monotonic nsec */
+    void    (*start)( struct supervisor *sv, struct watcher_state *state ); /* the restart is due */
+    void    (*log)( struct supervisor *sv, int prio, const char *msg );
+};
+
+struct supervisor {
+    const struct supervisor_ops *ops;
+    void          *ctx;      /* of the owner */
+    struct twheel *wheel;    /* of the restart timers */
+    int            debug;    /* LOG_DEBUG messages too */
+    struct {
+        uint64_t   exits;
+        uint64_t   abnormal; /* exit status != 0, or signaled */
+        uint64_t   window;   /* tripped, slept */
+        uint64_t   ewma;
+        uint64_t   bucket;
+        uint64_t   restarts; /* due */
+    } stat;
+};
+
+void supervise_init( struct supervisor *sv, const struct supervisor_ops *ops, void *ctx,
+                     struct twheel *wheel );
+int  supervise_state( struct supervisor *sv, struct watcher_state *state );
+void supervise_restore( struct watcher_state *state, int64_t when );
+void supervise_crashed( struct supervisor *sv, struct watcher_state *state, int64_t now );
+int  supervise_check( struct supervisor *sv, struct watcher_state *state, int64_t now );
+int  supervise_exited( struct supervisor *sv, struct watcher_state *state );
+
+#endif /* __WATCHER_SUPERVISE_H__ */
@@ -0,0 +1,270 @@
+/*
+ * twheel.c : hierarchical hashed timer wheel for watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "twheel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#define NOT_ARMED  UINT64_MAX
+#define MAXDELTA   ( ( (uint64_t)1 << ( TWHEEL_BITS * TWHEEL_LEVELS ) ) - 1 )
+
+static int64_t monotonic_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * usefd : drive by timerfd, or by the owner's twheel_advance().
+ */
+int twheel_init( struct twheel *w, int64_t tick_ns, int64_t now, int usefd )
+{
+    memset( w, 0x00, sizeof( *w ) );
+    w->fd      = -1;
+    w->tick_ns = ( tick_ns > 0 ) ? tick_ns : TWHEEL_TICK;
+    w->origin  = now;
+    w->now     = 0;
+    w->armed   = NOT_ARMED;
+    w->pending = 0;
+
+    if( usefd )
+    {
+        w->fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+        if( w->fd < 0 ) return -1;
+    }
+    return 0;
+}
+
+void twheel_destroy( struct twheel *w )
+{
+    if( w->fd >= 0 ) close( w->fd );
+    w->fd = -1;
+}
+
+void twheel_timer_init( struct twheel_timer *t, twheel_func func, void *arg )
+{
+    t->next   = NULL;
+    t->pprev  = NULL;
+    t->expire = 0;
+    t->func   = func;
+    t->arg    = arg;
+}
+
+/*
+ * private method: hash the timer into the slot for its distance.
+ */
+static void place( struct twheel *w, struct twheel_timer *t )
+{
+    uint64_t delta = t->expire - w->now;
+    int      level, idx;
+
+    for( level = 0 ; level < TWHEEL_LEVELS -1 ; level ++ )
+    {
+        if( delta < ( (uint64_t)1 << ( TWHEEL_BITS * ( level +1 ) ) ) ) break;
+    }
+    idx = ( t->expire >> ( TWHEEL_BITS * level ) ) & TWHEEL_MASK;
+
+    t->next  = w->slots[level][idx];
+    if( t->next != NULL ) t->next->pprev = &( t->next );
+    t->pprev = &( w->slots[level][idx] );
+    w->slots[level][idx] = t;
+    w->bitmap[level][ idx / 64 ] |= (uint64_t)1 << ( idx % 64 );
+}
+
+static void unlink_timer( struct twheel *w, struct twheel_timer *t )
+{
+   *t->pprev = t->next;
+    if( t->next != NULL ) t->next->pprev = t->pprev;
+    t->next  = NULL;
+    t->pprev = NULL;
+}
+
+/*
+ * private method: list of the slot is moved to *head, and the slot becomes empty.
+ */
+static void take_slot( struct twheel *w, int level, int idx, struct twheel_timer **head )
+{
+   *head = w->slots[level][idx];
+    w->slots[level][idx] = NULL;
+    w->bitmap[level][ idx / 64 ] &= ~( (uint64_t)1 << ( idx % 64 ) );
+    if( *head != NULL ) ( *head )->pprev = head;
+}
+
+static void cascade( struct twheel *w )
+{
+    int level, idx;
+
+    for( level = 1 ; level < TWHEEL_LEVELS ; level ++ )
+    {
+        struct twheel_timer *t, *n, *list;
+
+        idx = ( w->now >> ( TWHEEL_BITS * level ) ) & TWHEEL_MASK;
+        take_slot( w, level, idx, &list );
+        for( t = list ; t != NULL ; t = n )
+        {
+            n = t->next;
+            place( w, t );
+        }
+        if( idx != 0 ) break;
+    }
+}
+
+/*
+ * private method: next tick which needs work in the current round of
+ * level 0, or the head of the next round ( cascade point ).
+ */
+static uint64_t next_tick( const struct twheel *w )
+{
+    int i   = w->now & TWHEEL_MASK;
+    int wd  = i / 64;
+    uint64_t bits = w->bitmap[0][wd] & ( ~(uint64_t)0 << ( i % 64 ) );
+
+    for(;;)
+    {
+        if( bits ) return ( w->now & ~(uint64_t)TWHEEL_MASK ) + wd * 64 + __builtin_ctzll( bits );
+        if( ++wd >= TWHEEL_SLOTS / 64 ) break;
+        bits = w->bitmap[0][wd];
+    }
+    return ( w->now | TWHEEL_MASK ) + 1;
+}
+
+static void rearm( struct twheel *w )
+{
+    struct itimerspec its;
+    int64_t           when;
+
+    if( w->fd < 0 ) return ;
+
+    memset( &its, 0x00, sizeof( its ) );
+    if( w->pending > 0 )
+    {
+        w->armed = next_tick( w );
+        when = w->origin + (int64_t)w->armed * w->tick_ns;
+        its.it_value.tv_sec  = when / 1000000000LL;
+        its.it_value.tv_nsec = when % 1000000000LL;
+        if( its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0 )
+            its.it_value.tv_nsec = 1; // zero means disarm.
+    }
+    else
+    {
+        w->armed = NOT_ARMED;
+    }
+    timerfd_settime( w->fd, TFD_TIMER_ABSTIME, &its, NULL );
+}
+
+/*
+ * arm the timer at 'when' ( CLOCK_MONOTONIC nsec ). re-arming is allowed.
+ */
+void twheel_add( struct twheel *w, struct twheel_timer *t, int64_t when )
+{
+    int64_t tick;
+
+    if( twheel_armed( t ) ) twheel_cancel( w, t );
+
+    tick = ( when - w->origin + w->tick_ns - 1 ) / w->tick_ns;
+    if( when <= w->origin || (uint64_t)tick < w->now ) tick = w->now;
+    if( (uint64_t)tick - w->now > MAXDELTA ) tick = w->now + MAXDELTA;
+
+    t->expire = tick;
+    place( w, t );
+    w->pending ++;
+
+    if( t->expire < w->armed ) rearm( w ); // only when it comes earlier.
+}
+
+void twheel_cancel( struct twheel *w, struct twheel_timer *t )
+{
+    if( !twheel_armed( t ) ) return ;
+
+    unlink_timer( w, t );
+    w->pending --;
+}
+
+/*
+ * run all timers expired until 'now'. returns the number of expired timers.
+ */
+int twheel_advance( struct twheel *w, int64_t now )
+{
+    uint64_t target, tick;
+    int      count = 0;
+
+    if( now < w->origin ) return 0;
+    target = ( now - w->origin ) / w->tick_ns;
+
+    while( w->now <= target )
+    {
+        struct twheel_timer *t, *list;
+
+        if( w->pending == 0 )
+        {
+            w->now = target +1;
+            break;
+        }
+        if( ( w->now & TWHEEL_MASK ) == 0 ) cascade( w );
+
+        tick = next_tick( w );
+        if( tick > target )
+        {
+            w->now = target +1;
+            break;
+        }
+        if( tick != w->now && ( tick & TWHEEL_MASK ) == 0 )
+        {
+            w->now = tick; // cascade point.
+            continue;
+        }
+        take_slot( w, 0, tick & TWHEEL_MASK, &list );
+        w->now = tick +1; // timers added by callbacks go to the next tick.
+
+        // run the batch. a callback may cancel the rest of the batch.
+        while( ( t = list ) != NULL )
+        {
+            unlink_timer( w, t );
+            w->pending --;
+            count ++;
+            t->func( w, t, t->arg );
+        }
+    }
+    return count;
+}
+
+/*
+ * timerfd is readable, run expired timers and re-arm.
+ */
+int twheel_dispatch( struct twheel *w )
+{
+    uint64_t exp;
+    int      count;
+
+    if( w->fd >= 0 )
+    {
+        while( read( w->fd, &exp, sizeof( exp ) ) < 0 && errno == EINTR )
+            ;
+    }
+    count = twheel_advance( w, monotonic_now() );
+    rearm( w );
+    return count;
+}
+
+/*
+ * CLOCK_MONOTONIC nsec of the next work, -1 if no timer.
+ */
+int64_t twheel_next( const struct twheel *w )
+{
+    if( w->pending == 0 ) return -1;
+
+    return w->origin + (int64_t)next_tick( w ) * w->tick_ns;
+}
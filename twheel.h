@@ -0,0 +1,60 @@
+/*
+ * twheel.h : hierarchical hashed timer wheel for watcher.
+ *
+ *  TWHEEL_LEVELS wheels of TWHEEL_SLOTS slots. a timer is hashed into
+ *  the level covering its distance, and cascaded down to the lower
+ *  level when the lower wheel wraps around.
+ *  insert and cancel are O(1), expiry is done by slot ( batched ).
+ *
+ *  the whole wheel is driven by a single timerfd ( CLOCK_MONOTONIC ),
+ *  armed to the next slot that needs work. without timerfd ( fd < 0 ),
+ *  the owner drives it by twheel_advance() with its own clock.
+ */
+#ifndef __WATCHER_TWHEEL_H__
+#define __WATCHER_TWHEEL_H__
+
+#include <stdint.h>
+
+#define TWHEEL_BITS    8
+#define TWHEEL_SLOTS   ( 1 << TWHEEL_BITS )
+#define TWHEEL_MASK    ( TWHEEL_SLOTS - 1 )
+#define TWHEEL_LEVELS  4
+#define TWHEEL_TICK    1000000LL  /* default resolution, 1msec */
+
+struct twheel;
+struct twheel_timer;
+
+typedef void (*twheel_func)( struct twheel *w, struct twheel_timer *t, void *arg );
+
+struct twheel_timer {
+    struct twheel_timer  *next;
+    struct twheel_timer **pprev;  /* NULL if not armed */
+    uint64_t              expire; /* tick */
+    twheel_func           func;
+    void                 *arg;
+};
+
+struct twheel {
+    int       fd;                 /* timerfd, -1 if driven by owner */
+    int64_t   tick_ns;            /* resolution */
+    int64_t   origin;             /* CLOCK_MONOTONIC nsec of tick 0 */
+    uint64_t  now;                /* processed until this tick */
+    uint64_t  armed;              /* tick the timerfd is armed for */
+    int       pending;            /* armed timers */
+    uint64_t  bitmap[TWHEEL_LEVELS][TWHEEL_SLOTS / 64];
+    struct twheel_timer *slots[TWHEEL_LEVELS][TWHEEL_SLOTS];
+};
+
+int  twheel_init( struct twheel *w, int64_t tick_ns, int64_t now, int usefd );
+void twheel_destroy( struct twheel *w );
+
+void twheel_timer_init( struct twheel_timer *t, twheel_func func, void *arg );
+void twheel_add( struct twheel *w, struct twheel_timer *t, int64_t when );
+void twheel_cancel( struct twheel *w, struct twheel_timer *t );
+#define twheel_armed( T )  ( ( T )->pprev != NULL )
+
+int     twheel_advance( struct twheel *w, int64_t now );
+int     twheel_dispatch( struct twheel *w );
+int64_t twheel_next( const struct twheel *w );
+
+#endif /* __WATCHER_TWHEEL_H__ */
@@ -0,0 +1,243 @@
+/*
+ * uring.c : a small io_uring, by the raw system calls.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sys_setup( unsigned entries, struct io_uring_params *p )
+{
+    return syscall( __NR_io_uring_setup, entries, p );
+}
+
+static int sys_enter( int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argsz )
+{
+    return syscall( __NR_io_uring_enter, fd, submit, wait, flags, arg, argsz );
+}
+
+static int sys_register( int fd, unsigned op, void *arg, unsigned n )
+{
+    return syscall( __NR_io_uring_register, fd, op, arg, n );
+}
+
+/*
+ * -1 if io_uring is not there ( ENOSYS, or disabled ), or too old.
+ */
+int uring_init( struct uring *u, unsigned entries )
+{
+    struct io_uring_params p;
+
+    memset( u, 0x00, sizeof( *u ) );
+    memset( &p, 0x00, sizeof( p ) );
+    u->fd = sys_setup( entries, &p );
+    if( u->fd < 0 ) return -1;
+
+    // the timeout of the wait is needed.
+    if( !( p.features & IORING_FEAT_EXT_ARG ) )
+    {
+        close( u->fd );
+        errno = ENOSYS;
+        return -1;
+    }
+    u->entries = p.sq_entries;
+    u->sq_len  = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+    u->cq_len  = p.cq_off.cqes  + p.cq_entries * sizeof( struct io_uring_cqe );
+    if( p.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        if( u->cq_len > u->sq_len ) u->sq_len = u->cq_len;
+        u->cq_len = u->sq_len;
+    }
+    u->sq_ring = mmap( NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       u->fd, IORING_OFF_SQ_RING );
+    if( u->sq_ring == MAP_FAILED ) goto error;
+    if( p.features & IORING_FEAT_SINGLE_MMAP )
+        u->cq_ring = u->sq_ring;
+    else
+    {
+        u->cq_ring = mmap( NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           u->fd, IORING_OFF_CQ_RING );
+        if( u->cq_ring == MAP_FAILED ) goto error;
+    }
+    u->sqes_len = p.sq_entries * sizeof( struct io_uring_sqe );
+    u->sqes = mmap( NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    u->fd, IORING_OFF_SQES );
+    if( u->sqes == MAP_FAILED ) goto error;
+
+    u->sq_head  = (unsigned *)( (char *)u->sq_ring + p.sq_off.head );
+    u->sq_tail  = (unsigned *)( (char *)u->sq_ring + p.sq_off.tail );
+    u->sq_mask  = (unsigned *)( (char *)u->sq_ring + p.sq_off.ring_mask );
+    u->sq_array = (unsigned *)( (char *)u->sq_ring + p.sq_off.array );
+    u->cq_head  = (unsigned *)( (char *)u->cq_ring + p.cq_off.head );
+    u->cq_tail  = (unsigned *)( (char *)u->cq_ring + p.cq_off.tail );
+    u->cq_mask  = (unsigned *)( (char *)u->cq_ring + p.cq_off.ring_mask );
+    u->cqes     = (struct io_uring_cqe *)( (char *)u->cq_ring + p.cq_off.cqes );
+    return 0;
+
+ error:
+    close( u->fd );
+    u->fd = -1;
+    return -1;
+}
+
+void uring_exit( struct uring *u )
+{
+    if( u->fd < 0 ) return ;
+    close( u->fd );
+    munmap( u->sqes, u->sqes_len );
+    if( u->cq_ring != u->sq_ring ) munmap( u->cq_ring, u->cq_len );
+    munmap( u->sq_ring, u->sq_len );
+    if( u->br != NULL ) munmap( u->br, u->nbufs * sizeof( struct io_uring_buf ) );
+    free( u->bufs );
+    u->fd = -1;
+}
+
+/*
+ * 1 if the kernel knows the opcode.
+ */
+int uring_supported( struct uring *u, int op )
+{
+    struct io_uring_probe *probe;
+    size_t len = sizeof( struct io_uring_probe ) + 256 * sizeof( struct io_uring_probe_op );
+    int    ok;
+
+    probe = calloc( len, 1 );
+    if( probe == NULL ) return 0;
+    if( sys_register( u->fd, IORING_REGISTER_PROBE, probe, 256 ) < 0 )
+    {
+        free( probe );
+        return 0;
+    }
+    ok = ( op <= probe->last_op && ( probe->ops[op].flags & IO_URING_OP_SUPPORTED ) );
+    free( probe );
+    return ok;
+}
+
+/*
+ * nbufs ( power of 2 ) buffers of bufsiz for IOSQE_BUFFER_SELECT, group 0.
+ */
+int uring_buffers( struct uring *u, unsigned nbufs, unsigned bufsiz )
+{
+    struct io_uring_buf_reg reg;
+    unsigned i;
+
+    u->br = mmap( NULL, nbufs * sizeof( struct io_uring_buf ), PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0 );
+    if( u->br == MAP_FAILED )
+    {
+        u->br = NULL;
+        return -1;
+    }
+    u->nbufs  = nbufs;
+    u->bufsiz = bufsiz;
+    u->bufs   = malloc( (size_t)nbufs * bufsiz );
+    if( u->bufs == NULL ) return -1;
+
+    memset( &reg, 0x00, sizeof( reg ) );
+    reg.ring_addr    = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = nbufs;
+    reg.bgid         = 0;
+    if( sys_register( u->fd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 ) return -1;
+
+    u->br->tail = 0;
+    for( i = 0 ; i < nbufs ; i ++ ) uring_buf_return( u, i );
+    return 0;
+}
+
+/*
+ * give the buffer back to the kernel.
+ */
+void uring_buf_return( struct uring *u, unsigned id )
+{
+    unsigned short tail = u->br->tail;
+    struct io_uring_buf *b = &( u->br->bufs[ tail & ( u->nbufs - 1 ) ] );
+
+    b->addr = (uint64_t)(uintptr_t)uring_buf( u, id );
+    b->len  = u->bufsiz;
+    b->bid  = id;
+    __atomic_store_n( &( u->br->tail ), (unsigned short)( tail + 1 ), __ATOMIC_RELEASE );
+}
+
+/*
+ * an empty sqe, submitted by the next uring_enter(). the ring is
+ * submitted first if full. NULL if the kernel takes none now ( EBUSY ),
+ * the caller tries again after the next uring_enter().
+ */
+struct io_uring_sqe *uring_sqe( struct uring *u )
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *u->sq_tail, idx;
+
+    if( tail - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE ) >= u->entries )
+    {
+        uring_enter( u, 0, 0 );
+        if( tail - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE ) >= u->entries )
+        {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+    idx = tail & *u->sq_mask;
+    sqe = &( u->sqes[idx] );
+    memset( sqe, 0x00, sizeof( *sqe ) );
+    u->sq_array[idx] = idx;
+    __atomic_store_n( u->sq_tail, tail + 1, __ATOMIC_RELEASE );
+    u->pending ++;
+    return sqe;
+}
+
+/*
+ * submit what is pending, and wait for wait completions at most
+ * timeout_ns ( 0 : don't wait, -1 : no limit ).
+ */
+int uring_enter( struct uring *u, unsigned wait, int64_t timeout_ns )
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec      ts;
+    unsigned flags = 0;
+    int      ret;
+
+    memset( &arg, 0x00, sizeof( arg ) );
+    if( wait > 0 )
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        ts.tv_sec  = timeout_ns / 1000000000LL;
+        ts.tv_nsec = timeout_ns % 1000000000LL;
+        arg.sigmask_sz = _NSIG / 8;
+        if( timeout_ns >= 0 ) arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    u->enters ++;
+    ret = sys_enter( u->fd, u->pending, wait, flags, wait > 0 ? &arg : NULL, wait > 0 ? sizeof( arg ) : 0 );
+    // what the kernel took, even if the wait failed.
+    u->pending = *u->sq_tail - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE );
+    if( ret < 0 && ( errno == ETIME || errno == EINTR ) ) return 0;
+    return ret;
+}
+
+/*
+ * the next completion, NULL if none.
+ */
+struct io_uring_cqe *uring_cqe( struct uring *u )
+{
+    unsigned head = *u->cq_head;
+
+    if( head == __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE ) ) return NULL;
+    return &( u->cqes[ head & *u->cq_mask ] );
+}
+
+void uring_cqe_seen( struct uring *u )
+{
+    __atomic_store_n( u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE );
+}
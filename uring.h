@@ -0,0 +1,45 @@
+/*
+ * uring.h : a small io_uring, by the raw system calls.
+ *
+ *  just what the log pump needs : one submission / completion ring, and
+ *  one ring of provided buffers the kernel reads into.
+ */
+#ifndef __WATCHER_URING_H__
+#define __WATCHER_URING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/* newer than some headers, the ABI is fixed. */
+#define URING_OP_READ_MULTISHOT  49     /* linux 6.7 */
+
+struct uring {
+    int       fd;
+    unsigned  entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned  pending;     /* sqes not submitted yet */
+    void     *sq_ring, *cq_ring;
+    size_t    sq_len, cq_len, sqes_len;
+
+    struct io_uring_buf_ring *br; /* provided buffers, group 0 */
+    char     *bufs;
+    unsigned  nbufs, bufsiz;
+    uint64_t  enters;      /* io_uring_enter() calls */
+};
+
+int  uring_init( struct uring *u, unsigned entries );
+void uring_exit( struct uring *u );
+int  uring_supported( struct uring *u, int op );
+int  uring_buffers( struct uring *u, unsigned nbufs, unsigned bufsiz );
+#define uring_buf( U, ID )  ( ( U )->bufs + (size_t)( ID ) * ( U )->bufsiz )
+void uring_buf_return( struct uring *u, unsigned id );
+struct io_uring_sqe *uring_sqe( struct uring *u );
+int  uring_enter( struct uring *u, unsigned wait, int64_t timeout_ns );
+struct io_uring_cqe *uring_cqe( struct uring *u );
+void uring_cqe_seen( struct uring *u );
+
+#endif /* __WATCHER_URING_H__ */
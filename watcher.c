@@ -29,8 +29,24 @@
  */
 static char *__watcher_version = "2.05" ;
 
+#define _GNU_SOURCE /* pipe2 */
 #include "watcher.h"
 #include "progname.h"
+#include "journal.h"
+#include "rate.h"
+#include "twheel.h"
+#include "logpump.h"
+#include "placement.h"
+#include "listener.h"
+#include "logtap.h"
+#include "logfwd.h"
+#include "harden.h"
+#include "depgraph.h"
+#include "psi.h"
+#include "crashtail.h"
+#include "shmlog.h"
+#include "supervise.h"
+#include "uring.h"
 #include <stdio.h>
 #include <syslog.h>
 #include <unistd.h>
@@ -42,28 +58,75 @@ static char *__watcher_version = "2.05" ;
 #include <pwd.h>
 #include <grp.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
 
 
 /* default values */
 static const struct watcher_conf default_conf = {
     { DEFAULT_REGION, DEFAULT_COUNT },     /* alert time  */
+    { 0.0, 0.0 },                          /* ewma        */
+    { 0.0, 0.0 },                          /* bucket      */
     { LOG_LOCAL0,     LOG_ERR },           /* syslog      */
     -1, -1,                                /* uid and gid */
     DEFAULT_SLEEP,                         /* sleeptime   */
-    NULL,                                  /* progname    */
+    1,                                     /* logworkers  */
+    { 0.0, 0.0, 0.0, 0.0 },                /* loglimit    */
+    0, -1, -1,                             /* forward, outprio, errprio */
     NULL,                                  /* logfile     */
     NULL,                                  /* pidfile     */
+    NULL,                                  /* journal     */
+    { 0 },                                 /* placement   */
+    { { 0 } },                             /* housekeeping*/
+    1,                                     /* instances   */
+    NULL,                                  /* listen      */
+    0, 0,                                  /* lazy, idletime */
+    NULL,                                  /* tap         */
+    0,                                     /* hardened    */
+    NULL, 0,                               /* services, parallel */
+    NULL, 0,                               /* pressure, critical */
+    0, NULL,                               /* tailsize, taildir */
+    0,                                     /* uring       */
+    0,                                     /* shmlog      */
+    NULL,                                  /* progname    */
     0,                                     /* argc        */
     "/usr/bin/true", NULL, NULL, NULL,     /* argv[0..4]  */
 };
 
-static int childpid = 0;
 static int motherpid = 0;
-static int sigchildflag = 0;
-static int execerrcount = 0;
+static struct twheel wheel; /* all timers of watcher */
+static struct supervisor sv; /* the crash-loop policy */
+
+static struct watcher_state **states = NULL; /* instances */
+static int             nstates = 0;
+static int             listenfd = -1;
+static struct logpump *pump = NULL;
+static struct logfile *logf = NULL;
+static struct logfwd  *fwd  = NULL;
+static int             epfd = -1;
+static int             tapfd = -1;
+static struct depgraph *graph = NULL; /* -C */
+static struct psi      *psi = NULL;   /* -Q */
+static char            oomsaved[16]; /* oom_score_adj for the children, -M */
+static struct {
+    int      count;       /* restarts */
+    int64_t  total, max;  /* from due to fork(), nsec */
+} restartlat;
+static struct {
+    struct uring *u;         /* -U, NULL if on epoll */
+    int       sigfd;
+    sigset_t  mask;          /* of sigfd */
+    int       epoll;         /* epfd is polled by the ring */
+    int       unpolled;      /* a pidfd got no sqe, poll it next round */
+    int64_t   armed;         /* deadline of the timeout op, -1 if none */
+    uint64_t  waits;         /* epoll_wait() calls, on epoll */
+} mainloop;
 
 #ifdef DEBUG
 static int debugmode  = 1;
@@ -83,6 +146,9 @@ void show_help( int exval )
                      "\t -h         : show this help ( and terminate. )\n" 
                      "\t -t #t.#s   : if command terminate #t count in #s second,\n"
                      "\t              send log message.\n"
+                     "\t -e #tau:#r : if average crash rate ( time constant #tau sec )\n"
+                     "\t              exceed #r count / min, sleep.\n"
+                     "\t -b #r:#n   : allow #r restarts / min, burst #n.\n"
                      "\t -k #t      : restart application each #t sec. (not implemented yet.)\n"
                      "\t -K #H:#M   : restart application every #H:#M. (not implemented yet.)\n"
                      "\t -f #       : set syslog facility LOCAL# ( # = 0-7 )\n"
@@ -90,7 +156,40 @@ void show_help( int exval )
                      "\t -g #       : set group as # ( root only )\n"
                      "\t -s #       : set sleep time \n"
                      "\t -l logfile : write stdout/stderr message to logfile.\n"
+                     "\t -w #       : use # threads for logging. ( default 1 )\n"
+                     "\t -H list    : pin logging threads to cpus in list.\n"
+                     "\t -F dest[:out[:err]] : forward stdout/stderr lines to dest ( syslog or\n"
+                     "\t              journal ) with priority out / err. ( e.g. local0.info )\n"
+                     "\t -R #b[:#n][,#l[:#n]] : limit logging of each instance to #b bytes / sec and\n"
+                     "\t              #l lines / sec, burst #n. over the limit is discarded and summarized.\n"
+                     "\t -c list    : run command on cpus in list. ( e.g. 0-3,8 )\n"
+                     "\t -c spread[:list] : one cpu for each instance.\n"
+                     "\t -c nodes   : one NUMA node for each instance.\n"
+                     "\t -m policy[:nodes] : NUMA memory policy. ( bind/interleave/preferred/local )\n"
+                     "\t -S policy[:prio]  : scheduling policy. ( other/batch/idle/fifo/rr )\n"
+                     "\t -N #       : nice value of command.\n"
+                     "\t -i class[:#] : I/O priority of command. ( rt/be/idle )\n"
+                     "\t -o #       : oom_score_adj of command.\n"
+                     "\t -n #       : keep # instances of command running. ( pool mode )\n"
+                     "\t -L [addr:]port : listen and pass the socket to command as fd 3.\n"
+                     "\t -A #       : start command on the first connection ( with -L ),\n"
+                     "\t              stop it after # sec without activity. ( 0 = never )\n"
+                     "\t -T socket  : live output of command to subscribers on socket. ( with -l or -F )\n"
+                     "\t -M         : hardened, lock memory and avoid the OOM killer.\n"
+                     "\t -C file    : run the services in file ( instead of command ), started in\n"
+                     "\t              dependency order.\n"
+                     "\t -P #       : start at most # services at once. ( with -C, 0 = no limit )\n"
+                     "\t -Q spec    : hold restarts while the host is under pressure.\n"
+                     "\t              spec : resource[:some|full]:stall[:window],... ( msec )\n"
+                     "\t -I         : critical, restarted even under pressure. ( with -Q )\n"
+                     "\t -D #[:dir] : keep the last # KB of output, dumped on abnormal termination\n"
+                     "\t              to syslog, or to dir/name.crash. ( mapped on dir/name.tail )\n"
+                     "\t -U         : log threads and main loop on io_uring. ( epoll if the kernel can't )\n"
+                     "\t -B #       : shared memory log ring of # KB for each instance, passed\n"
+                     "\t              to command in " SHMLOG_ENV "=memfd,eventfd.\n"
                      "\t -p pidfile : write PID to pidfile.\n"
+                     "\t -j journal : record process lifecycle to journal file. ( journal.name\n"
+                     "\t              for each service with -C )\n"
                      "\t --         : end of the watcher's option.\n"
                      "\n",
                      __progname, __watcher_version,  __progname);
@@ -104,6 +203,7 @@ void show_help( int exval )
 static void signal_handler2( int sig, struct watcher_conf *c )
 {
     static struct watcher_conf *config = NULL;
+    int i;
 
     if( sig == 0 ) // config set mode
     {
@@ -111,34 +211,25 @@ static void signal_handler2( int sig, struct watcher_conf *c )
         return ;
     }
     if( debugmode > 0 ) fprintf( stderr,"catch signal %d,"
-                " current child pid = %d\n", sig, childpid );
+                " current child pid = %d\n", sig, ( nstates > 0 ) ? states[0]->pid : 0 );
 
 #if defined( sun ) && defined( __svr4__ ) 
     signal( sig, signal_handler ); 
 #endif
     switch( sig )
     {
-    case SIGCHLD:
-         sigchildflag = 1;
-         return ;
-         
     case SIGHUP:
     case SIGTERM:
     case SIGINT:
     default:
-        kill( childpid, sig );
-        if( config->pidfile != NULL ) remove( config->pidfile );
-        exit( 0 );
-    case SIGUSR1:
-        execerrcount ++;
-        if( execerrcount > 3 ) 
+        for( i = 0 ; i < nstates ; i ++ )
         {
-            if( debugmode > 0 )
-                fprintf( stderr, "exec fail too many, terminate.\n" );
-            else
-                syslog( LOG_ERR, "exec fail too many, terminate." );
-            exit( 1 );
+            if( states[i]->pid > 0 ) kill( states[i]->pid, sig );
+            if( states[i]->tail != NULL ) states[i]->tail->pid = 0; // not left behind.
         }
+        if( config->pidfile != NULL ) remove( config->pidfile );
+        if( config->tap != NULL ) remove( config->tap );
+        exit( 0 );
     }
 }
 
@@ -172,12 +263,31 @@ static void print_conf(FILE *fp, struct watcher_conf *conf)
     int i ;
     fprintf( fp, "alert.region     = %d\n", conf->alert.region );
     fprintf( fp, "alert.count      = %d\n", conf->alert.count  );
+    fprintf( fp, "ewma.tau/limit   = %g / %g\n", conf->ewma.tau, conf->ewma.limit );
+    fprintf( fp, "bucket.rate/burst= %g / %g\n", conf->bucket.rate, conf->bucket.burst );
     fprintf( fp, "syslog.facility  = %d\n", conf->syslog.facility );
     fprintf( fp, "syslog.level     = %d\n", conf->syslog.level    );
     fprintf( fp, "uid/gid          = %d / %d\n", conf->uid, conf->gid  );
     fprintf( fp, "sleeptime        = %d\n", conf->sleeptime       );
+    fprintf( fp, "logworkers       = %d\n", conf->logworkers      );
+    fprintf( fp, "loglimit bytes   = %g : %g\n", conf->loglimit.bytes, conf->loglimit.bburst );
+    fprintf( fp, "loglimit lines   = %g : %g\n", conf->loglimit.lines, conf->loglimit.lburst );
+    fprintf( fp, "forward          = %d ( %d / %d )\n", conf->forward, conf->outprio, conf->errprio );
+    fprintf( fp, "housekeeping cpus= %d\n", cpumask_count( &( conf->housekeeping ) ) );
+    fprintf( fp, "placement flags  = 0x%04x\n", conf->place.flags   );
+    fprintf( fp, "instances        = %d\n", conf->instances       );
+    fprintf( fp, "listen           = %s\n", NULLCHK( conf->listen ) );
+    fprintf( fp, "lazy/idletime    = %d / %d\n", conf->lazy, (int)conf->idletime );
+    fprintf( fp, "tap              = %s\n", NULLCHK( conf->tap ) );
+    fprintf( fp, "hardened         = %d\n", conf->hardened );
+    fprintf( fp, "services         = %s ( %d at once )\n", NULLCHK( conf->services ), conf->parallel );
+    fprintf( fp, "pressure         = %s%s\n", NULLCHK( conf->pressure ), conf->critical ? " ( critical )" : "" );
+    fprintf( fp, "crash tail       = %d KB, %s\n", conf->tailsize, NULLCHK( conf->taildir ) );
+    fprintf( fp, "io_uring         = %d\n", conf->uring );
+    fprintf( fp, "shmlog           = %d KB\n", conf->shmlog );
     fprintf( fp, "logfile          = %s\n", NULLCHK( conf->logfile  ) );
     fprintf( fp, "pidfile          = %s\n", NULLCHK( conf->pidfile  ) );
+    fprintf( fp, "journal          = %s\n", NULLCHK( conf->journal  ) );
     fprintf( fp, "progname         = %s\n", NULLCHK( conf->progname ) );
 
     fprintf( fp, "argc             = %d\n", conf->argc    );
@@ -314,11 +424,13 @@ static const struct watcher_conf *init( int argc, char *argv[] )
     struct watcher_conf  confval = default_conf;
     struct watcher_conf *conf ;
     char *p ;
+    char *fwdprio = NULL ;
     int   i ;
     int size;
+    int ret;
 
     // option check
-    while( (c = getopt( argc, argv, "u:g:ht:f:s:d:l:p:V")) != EOF )
+    while( (c = getopt( argc, argv, "u:g:ht:e:b:f:s:d:l:w:H:R:F:c:m:S:N:i:o:n:L:A:T:MC:P:Q:ID:UB:p:j:V")) != EOF )
     {
         switch( c )
         {
@@ -334,6 +446,20 @@ static const struct watcher_conf *init( int argc, char *argv[] )
                 confval.alert.count = atoi( optarg );
             }
             break;
+        case 'e':
+            if( optarg == NULL ) continue;
+
+            confval.ewma.tau = atof( optarg );
+            p = strchr( optarg, ':' );
+            if( p != NULL ) confval.ewma.limit = atof( p+1 );
+            break;
+        case 'b':
+            if( optarg == NULL ) continue;
+
+            confval.bucket.rate = atof( optarg );
+            p = strchr( optarg, ':' );
+            confval.bucket.burst = ( p != NULL ) ? atof( p+1 ) : 1.0 ;
+            break;
         case 'f':
             if( optarg == NULL ) continue;
             switch(  atoi( optarg ) )
@@ -362,6 +488,159 @@ static const struct watcher_conf *init( int argc, char *argv[] )
             confval.logfile = strdup( optarg );
             break;
 
+        case 'w' : //log workers
+            i = atoi( optarg );
+            if( i < 1 || i > LOGPUMP_MAXWORKERS ) continue;
+
+            confval.logworkers = i;
+            break;
+
+        case 'R' : //log rate limit, bytes[:burst][,lines[:burst]]
+            confval.loglimit.bytes  = strtod( optarg, &p );
+            confval.loglimit.bburst = ( *p == ':' ) ? strtod( p+1, &p ) : 0.0;
+            if( *p == ',' )
+            {
+                confval.loglimit.lines  = strtod( p+1, &p );
+                confval.loglimit.lburst = ( *p == ':' ) ? strtod( p+1, &p ) : 0.0;
+            }
+            if( *p != '\0' || confval.loglimit.bytes < 0.0 || confval.loglimit.lines < 0.0 )
+            {
+                fprintf( stderr, "broken rate limit '%s'.\n", optarg );
+                exit( 2 );
+            }
+            break;
+
+        case 'F' : //forward to syslog or journald
+            p = strchr( optarg, ':' );
+            i = ( p == NULL ) ? strlen( optarg ) : p - optarg;
+            if(      i > 0 && strncmp( optarg, "syslog",  i ) == 0 ) confval.forward = LOGFWD_SYSLOG;
+            else if( i > 0 && strncmp( optarg, "journal", i ) == 0 ) confval.forward = LOGFWD_JOURNAL;
+            else
+            {
+                fprintf( stderr, "unknown forward destination '%s'.\n", optarg );
+                exit( 2 );
+            }
+            fwdprio = ( p == NULL ) ? NULL : p+1; // resolved after -f.
+            break;
+
+        case 'H' : //housekeeping cpus for logging threads
+            if( cpumask_parse( &( confval.housekeeping ), optarg ) <= 0 )
+            {
+                fprintf( stderr, "invalid cpu list '%s'.\n", optarg );
+                exit( 6 );
+            }
+            break;
+
+        case 'c' : //cpu affinity
+            ret = placement_cpus( &( confval.place ), optarg );
+            goto placement;
+        case 'm' : //NUMA memory policy
+            ret = placement_mempolicy( &( confval.place ), optarg );
+            goto placement;
+        case 'S' : //scheduling policy
+            ret = placement_sched( &( confval.place ), optarg );
+            goto placement;
+        case 'i' : //I/O priority
+            ret = placement_ioprio( &( confval.place ), optarg );
+            goto placement;
+        case 'N' : //nice
+            confval.place.nice   = atoi( optarg );
+            confval.place.flags |= PLACE_NICE;
+            break;
+        case 'o' : //oom_score_adj
+            confval.place.oomadj = atoi( optarg );
+            confval.place.flags |= PLACE_OOMADJ;
+            ret = ( confval.place.oomadj < -1000 || confval.place.oomadj > 1000 ) ? -1 : 0;
+        placement:
+            if( ret < 0 )
+            {
+                fprintf( stderr, "invalid argument '%s' for -%c.\n", optarg, c );
+                exit( 6 );
+            }
+            break;
+
+        case 'n' : //instances
+            i = atoi( optarg );
+            if( i < 1 || i > MAX_INSTANCES ) continue;
+
+            confval.instances = i;
+            break;
+
+        case 'L' : //listen
+            if( confval.listen != NULL ) free( confval.listen );
+
+            confval.listen = strdup( optarg );
+            break;
+
+        case 'A' : //on-demand activation
+            i = atoi( optarg );
+            if( i < 0 ) continue;
+
+            confval.lazy     = 1;
+            confval.idletime = i;
+            break;
+
+        case 'T' : //log tap
+            if( confval.tap != NULL ) free( confval.tap );
+
+            confval.tap = strdup( optarg );
+            break;
+
+        case 'M' : //hardened
+            confval.hardened = 1;
+            break;
+
+        case 'C' : //services
+            if( confval.services != NULL ) free( confval.services );
+
+            confval.services = strdup( optarg );
+            break;
+
+        case 'P' : //services starting at once
+            i = atoi( optarg );
+            if( i < 0 ) continue;
+
+            confval.parallel = i;
+            break;
+
+        case 'Q' : //pressure
+            if( confval.pressure != NULL ) free( confval.pressure );
+
+            confval.pressure = strdup( optarg );
+            ret = ( psi = psi_parse( optarg ) ) ? 0 : -1;
+            goto placement;
+
+        case 'I' : //critical
+            confval.critical = 1;
+            break;
+
+        case 'D' : //crash tail
+            {
+                char *p = strchr( optarg, ':' );
+
+                i = atoi( optarg );
+                ret = ( i > 0 && i <= CRASHTAIL_MAXSIZE / 1024 ) ? 0 : -1;
+                if( p != NULL && ( p[1] == '\0' || access( p+1, W_OK ) < 0 ) ) ret = -1;
+                if( ret < 0 ) goto placement;
+
+                confval.tailsize = i;
+                if( confval.taildir != NULL ) free( confval.taildir );
+                confval.taildir = ( p == NULL ) ? NULL : strdup( p+1 );
+            }
+            break;
+
+        case 'U' : //io_uring
+            confval.uring = 1;
+            break;
+
+        case 'B' : //shared memory log
+            i = atoi( optarg );
+            ret = ( i > 0 && i <= SHMLOG_MAXSIZE / 1024 ) ? 0 : -1;
+            if( ret < 0 ) goto placement;
+
+            confval.shmlog = i;
+            break;
+
         case 'p' : //pidfile
             if( confval.pidfile != NULL ) free( confval.pidfile );
 
@@ -379,6 +658,12 @@ static const struct watcher_conf *init( int argc, char *argv[] )
             confval.pidfile = p; 
             break;
 
+        case 'j' : //journal
+            if( confval.journal != NULL ) free( confval.journal );
+
+            confval.journal = strdup( optarg );
+            break;
+
         case 'u' : //user id
             if( getuid() != 0 ) break;
 
@@ -402,6 +687,19 @@ static const struct watcher_conf *init( int argc, char *argv[] )
             exit(0);
         }
     }
+    if( confval.forward )
+    {
+        char out[64] = "info", err[64] = "err";
+
+        if( fwdprio != NULL ) sscanf( fwdprio, "%63[^:]:%63s", out, err );
+        confval.outprio = logfwd_priority( out, confval.syslog.facility );
+        confval.errprio = logfwd_priority( err, confval.syslog.facility );
+        if( confval.outprio < 0 || confval.errprio < 0 )
+        {
+            fprintf( stderr, "unknown priority '%s'.\n", fwdprio );
+            exit( 2 );
+        }
+    }
     conf = malloc( sizeof( struct watcher_conf ) + fixsize( argc +2 ) * sizeof( char * ) );
    *conf = confval;
 
@@ -412,6 +710,11 @@ static const struct watcher_conf *init( int argc, char *argv[] )
     conf->argv[i+1] = NULL ;
     conf->argc = i;
 
+    if( conf->progname == NULL && conf->argc == 0 && conf->services != NULL )
+    {
+        char *p = strrchr( conf->services, '/' );
+        conf->progname = (( p == NULL ) ? conf->services : p+1) ;
+    }
     if( conf->progname == NULL )
     {
         char *p = strrchr( conf->argv[0], '/' );
@@ -422,12 +725,27 @@ static const struct watcher_conf *init( int argc, char *argv[] )
 
 
     /* sanity checks */
-    if( conf->argc  <= 0 )
+    if( conf->services != NULL && ( conf->lazy || conf->instances > 1 ) )
+    {
+         fprintf( stderr,"-C can't be used with -A nor -n.\n" );
+         exit( 2 );
+    }
+    if( conf->argc  <= 0 && conf->services == NULL )
     {
          fprintf( stderr,"client program not specifiled.\n" );
          exit( 2 );
     }
-    if( 0 > access( conf->argv[0] , X_OK ) )
+    if( conf->lazy && conf->listen == NULL )
+    {
+         fprintf( stderr,"-A needs listening socket ( -L ).\n" );
+         exit( 2 );
+    }
+    if( conf->tap != NULL && conf->logfile == NULL && !conf->forward )
+    {
+         fprintf( stderr,"-T needs logging ( -l or -F ).\n" );
+         exit( 2 );
+    }
+    if( conf->argc > 0 && 0 > access( conf->argv[0] , X_OK ) )
     {
          fprintf( stderr,"client program '%s' not exist.\n", conf->argv[0] );
          exit( 2 );
@@ -436,10 +754,8 @@ static const struct watcher_conf *init( int argc, char *argv[] )
     /* signal handlers */ 
     signal_handler2( 0, conf ); // set config
     signal( SIGHUP,  signal_handler );
-    signal( SIGCHLD, signal_handler );
     signal( SIGINT,  signal_handler );
     signal( SIGTERM, signal_handler );
-    signal( SIGUSR1, signal_handler );
 
 #if defined( sun ) && defined( __svr4__ )
 #define LOG_PERROR 0
@@ -480,216 +796,175 @@ static int daemonize(void )
     return 1;
 }
 
-/*
- * get crash time 
- */
-time_t get_crashtime( const struct watcher_state *stat, int prev )
-{
-    if( prev >= 0 && prev < stat->length )
-    {
-        if( stat->last_slot > prev ) 
-            return stat->crashtimes[ stat->last_slot - prev ];
-        else
-            return stat->crashtimes[ stat->length + stat->last_slot - prev ] ;
-    }
-    return -1;
-}
-
-/*
- * set crash time 
- */
-void set_crashtime( struct watcher_state *stat )
-{
-    if( stat->last_slot +1 <  stat->length )
-    {
-        stat->crashtimes[ ++( stat->last_slot ) ] = time( NULL );
-    }
-    else
-    {
-        stat->last_slot=0;
-        stat->crashtimes[ 0 ] = time(NULL);
-    }
-    if( debugmode > 0 ) fprintf( stderr,"set crash[%02d] -> %d\n", 
-        stat->last_slot, stat->crashtimes[ stat->last_slot ] );
-    return;
-}
-
+static void lazy_stopped( void );
+static void ring_watch( struct watcher_state *state );
 
 /*
- *
+ * environment of the instance, made before fork().
+ *   LISTEN_PID is filled by the child, only it knows its own pid.
  */
-static int check_state( const struct watcher_state *state, int reg, int cont )
+static int makeenv( struct watcher_state *state )
 {
-    time_t c,p,d;
+    extern char **environ;
+    char   buff[64];
+    int    i, j, n;
 
-    if( cont < 1 || reg < 1 ) return 0; // no count.
+    for( n = 0 ; environ[n] != NULL ; n ++ )
+        ;
+    state->envp = malloc( sizeof( char * ) * ( n + 6 ) );
+    if( state->envp == NULL ) return -1;
 
-    c =  get_crashtime( state, 0 /*current*/ );
-    p =  get_crashtime( state, cont - 1 );
-    d = c - p;
-    if( debugmode > 0 ) fprintf( stderr,"c %d, p %d, reg %d, diff %d\n",
-                                  c,p,reg, d );
-    if( ( p != 0 ) &&  ( d > 0 ) && ( d <= reg ) )
+    for( i = j = 0 ; i < n ; i ++ )
     {
-        if( debugmode > 0 )
-            fprintf( stderr, "process down too many, sleeping.\n", cont, reg );
-        else
-            syslog( LOG_ERR, "process down too many, sleeping.", cont, reg );
-        return -1; /* problem? */
+        // ours are replaced.
+        if( strncmp( environ[i], "WATCHER_INSTANCE", 16 ) == 0 
+         || strncmp( environ[i], SHMLOG_ENV "=", strlen( SHMLOG_ENV ) + 1 ) == 0
+         || strncmp( environ[i], "LISTEN_", 7 ) == 0 ) continue;
+        state->envp[j++] = environ[i];
     }
-    if( execerrcount > 0 ) 
+    snprintf( buff, sizeof( buff ), "WATCHER_INSTANCE=%d", state->index );
+    state->envp[j++] = strdup( buff );
+    snprintf( buff, sizeof( buff ), "WATCHER_INSTANCES=%d", state->config->instances );
+    state->envp[j++] = strdup( buff );
+    if( state->shm != NULL )
     {
-        return -1;
+        snprintf( buff, sizeof( buff ), SHMLOG_ENV "=%d,%d", state->shm->memfd, state->shm->evfd );
+        state->envp[j++] = strdup( buff );
     }
-    if( WEXITSTATUS( state->wstatus ) != 0)
+
+    state->pidslot = NULL;
+    if( listenfd >= 0 )
     {
-        if( debugmode > 0 )
-            fprintf( stderr, "process abnormal terminate, status = %d.\n", 
-                WEXITSTATUS( state->wstatus ));
-        else
-            syslog( LOG_ERR, "process abnormal terminate, status = %d.", 
-                WEXITSTATUS( state->wstatus ));
-        return 0; /* problem? */
+        state->envp[j++] = strdup( "LISTEN_FDS=1" );
+        state->envp[j++] = state->pidslot = strdup( "LISTEN_PID=" "0000000000000000000" );
     }
+    state->envp[j] = NULL;
 
-    execerrcount = 0;
-
-    return 0;// no-problem
+    while( --j >= 0 )
+    {
+        if( state->envp[j] == NULL ) return -1;
+    }
+    return 0;
 }
 
-static struct watcher_state *makestate( const struct watcher_conf *config )
+static struct watcher_state *makestate( const struct watcher_conf *config, int index,
+                                        struct journal *journal )
 {
     struct watcher_state *c;
-    c = calloc( sizeof( struct watcher_state )
-                +  sizeof( time_t ) * ( config->alert.count *3 ), 1 );
+    int64_t now = journal_now( CLOCK_MONOTONIC );
+
+    c = calloc( sizeof( struct watcher_state ), 1 );
     if( c == NULL ) return NULL;
 
-    c->length =  config->alert.count *3 ;
+    c->config  = config;
+    c->index   = index;
+    c->pid     = 0;
+    c->pidfd   = -1;
     c->wstatus = 0;
-    c->last_slot = -1;// little magic
-
-    if( debugmode > 0 )
-        fprintf( stderr, "slot length = %d\n", c->length );
-    return c;
-}
-
- 
-static int writelog( const char *logfilename, int fd, struct stat* oldbuf, int *ffd )
-{
-    int    ret, siz, rop ;
-    char buff[BUFSIZ]; 
-    struct stat stbuf;
-
-    memset( &stbuf, 0x00, sizeof( stbuf ) );
-    memset( buff,   0x00, sizeof( buff ) );
-
-    siz = read( fd, buff, sizeof( buff ) -1 ); // preserve last '\0' 
-    if( siz <= 0 ) //error
+    c->journal = journal;
+    if( config->instances > 1 ) snprintf( c->tag, sizeof( c->tag ), " #%d", index );
+    if( supervise_state( &sv, c ) < 0 )
     {
-        return 0; //FIXME
+        free( c );
+        return NULL;
     }
 
+    if( journal != NULL )
+    {
+        int i, n, len = journal_length( journal );
+        int instance = ( graph != NULL ) ? 0 : index; // a file for each service.
+
+        // restore crash history of the previous watcher, this instance only.
+        // monotonic time of the other boot is meaningless, skip it.
+        for( i = n = 0 ; i < len ; i ++ )
+        {
+            if( journal_get( journal, i )->instance != instance ) continue;
+            if( c->window != NULL && ++n >= c->window->length ) break;
+        }
+        if( i >= len ) i = len -1;
+        for( ; i >= 0 ; i -- )
+        {
+            const struct journal_rec *r = journal_get( journal, i );
 
-    if( *ffd < 0 ) 
+            if( r->instance != instance ) continue;
+            if( !journal_sameboot( journal, i ) || r->mono_ns > now ) continue;
+            supervise_restore( c, r->mono_ns );
+        }
+    }
+    if( config->tailsize > 0 )
     {
-        rop = 1;
-    }else{
-        ret = stat( logfilename, &stbuf );
-        if( ret < 0 )
-        { 
-            rop = 1 ;
-        }else{
-            if( ( stbuf.st_ino   != oldbuf->st_ino ) 
-             || ( stbuf.st_mtime != oldbuf->st_mtime ) )
-            {
-               rop = 1;
-              *oldbuf = stbuf ;
-            }
+        char name[64];
+
+        if( config->instances > 1 )
+            snprintf( name, sizeof( name ), "%s.%d", config->progname, index );
+        else
+            snprintf( name, sizeof( name ), "%s", config->progname );
+        c->tail = crashtail_open( name, config->tailsize * 1024, config->taildir, debugmode );
+        if( c->tail == NULL )
+        {
+            fprintf( stderr, "can't open crash tail of %s, %s\n", name, strerror( errno ) );
+            free( c->window );
+            free( c );
+            return NULL;
         }
     }
-        
-    if( rop > 0 )
+    if( config->logfile != NULL && ( config->loglimit.bytes > 0.0 || config->loglimit.lines > 0.0 ) )
     {
-        if( *ffd >= 0 ) close( *ffd );
-       *ffd = open( logfilename, O_CREAT |O_WRONLY| O_APPEND,
-                    ( oldbuf->st_mode > 0 ) ? oldbuf->st_mode : 0644 );
-        if( *ffd < 0 )
+        char name[64];
+
+        snprintf( name, sizeof( name ), "%s%s", config->progname, c->tag + ( c->tag[0] == ' ' ) );
+        c->limit = loglimit_new( name, config->loglimit.bytes, config->loglimit.bburst,
+                                       config->loglimit.lines, config->loglimit.lburst );
+        if( c->limit == NULL )
         {
-            if( debugmode > 0 )
-                fprintf( stderr, "can't re-open '%s', reason '%s', msg '%s'\n", 
-                                      logfilename, strerror( errno ), buff );
-            else
-                syslog( LOG_WARNING, "can't re-open '%s', reason '%s', msg '%s'", 
-                                      logfilename, strerror( errno ), buff );
-        }else{
-            if( getuid() == 0 )
-            {
-                if( oldbuf->st_uid != 0 || oldbuf->st_gid != 0 ) 
-                {
-                    fchown( *ffd, oldbuf->st_uid, oldbuf->st_gid );
-                }
-            }
-            write( *ffd, buff, siz );
+            free( c->window );
+            free( c );
+            return NULL;
         }
-    }else{
-        write( *ffd, buff, siz );
     }
-    return 0; 
+    if( config->shmlog > 0 && !( c->shm = shmlog_create( config->shmlog * 1024 ) ) )
+    {
+        fprintf( stderr, "can't create shared memory log of %s%s, %s\n",
+                         config->progname, c->tag, strerror( errno ) );
+        free( c->window );
+        free( c );
+        return NULL;
+    }
+    if( makeenv( c ) < 0 )
+    {
+        free( c->window );
+        free( c );
+        return NULL;
+    }
+    return c;
 }
 
-static int logging( const char *logfilename, int outh, int errh )
+/*
+ * record a termination of the child to journal.
+ */
+static void record_state( struct watcher_state *state, pid_t pid )
 {
-    struct stat statbuf ;
-    int    logfd = -1 ;
-    int    ret ;
-    fd_set rfds;
-    int    max ;
-
-    ret = stat( logfilename, &statbuf );
-    if( ret < 0 ) 
-    {
-       memset( &statbuf, 0x00, sizeof( statbuf ) );
-        //FIXME
-    }
+    struct journal_rec rec;
 
-    while(1)
-    {
-        FD_ZERO( &rfds );
-        FD_SET( outh, &rfds );
-        FD_SET( errh, &rfds );
+    if( state->journal == NULL ) return ;
 
-        max = outh > errh ? outh:errh;
+    memset( &rec, 0x00, sizeof( rec ) );
+    rec.mono_ns    = journal_now( CLOCK_MONOTONIC );
+    rec.wall_ns    = journal_now( CLOCK_REALTIME );
+    rec.run_ns     = rec.mono_ns - state->starttime;
+    rec.pid        = pid;
+    rec.generation = state->journal->head->generation;
+    rec.wstatus    = state->wstatus;
+    rec.instance   = ( graph != NULL ) ? 0 : state->index; // a file for each service.
 
-        ret = select( max+1, &rfds, NULL, NULL, NULL );
-        if( !ret )
-        {
-            switch( errno )
-            {
-            case EINTR:
-                 break;
-            default: 
-                continue ;
-            }
-        }
-        if( FD_ISSET( outh, &rfds ) )
-        {
-            writelog( logfilename, outh, &statbuf, &logfd );
-        } 
-        if( FD_ISSET( errh, &rfds ) )
-        {
-            writelog( logfilename, errh, &statbuf, &logfd );
-        } 
-        if( sigchildflag ) 
-        {
-            close( logfd );
-            return 0 ;
-        }
-     }
+    journal_append( state->journal, &rec );
 }
 
-static int writepidfile( const char *pidfilename, pid_t childpid )
+ 
+static int writepidfile( const char *pidfilename )
 {
     int fd ;
+    int i, len;
     char buff[1024]; // FIXME
 
     fd = open( pidfilename, O_CREAT |O_WRONLY| O_TRUNC, 0644 );
@@ -703,158 +978,1218 @@ static int writepidfile( const char *pidfilename, pid_t childpid )
                                   pidfilename, strerror( errno ) );
         return 0;
     }
-    if( childpid != 0 )
-        sprintf( buff, "%d\n%d\n", getpid(), childpid );
-    else
-        sprintf( buff, "%d\n", getpid() );
+    // watcher, and running instances.
+    len = sprintf( buff, "%d\n", getpid() );
+    for( i = 0 ; i < nstates && len < sizeof( buff ) - 16 ; i ++ )
+    {
+        if( states[i]->pid != 0 )
+            len += sprintf( buff + len, "%d\n", states[i]->pid );
+    }
 
-    write( fd, buff, strlen( buff ) );
+    write( fd, buff, len );
     close( fd ); 
 
     return 1;
 }
 
+/*
+ * private method: async-signal-safe itoa, for the child after fork().
+ */
+static void fmtpid( char *p, pid_t pid )
+{
+    char  buff[24];
+    int   i = 0;
+
+    do{
+        buff[i++] = '0' + pid % 10;
+        pid /= 10;
+    }while( pid > 0 );
+    while( i > 0 ) *p++ = buff[--i];
+   *p = '\0';
+}
+
 #define MOTHERSIDE  0
 #define CHILDSIDE   1
+#define SIGEXECFAIL ( SIGRTMIN + 0 ) /* from the child, queued with its pid and step */
+#define CHILD_EXEC  0                /* the step of execve(), or PLACE_FAIL_* */
 
-int main (int argc, char *argv[] )
+/*
+ * a step of the child failed. the child doesn't log, a log thread may have
+ * held a lock of syslog or stdio at fork(). watcher logs it.
+ */
+static void childfail( int step )
 {
-    const struct watcher_conf  *config = NULL;
-    struct       watcher_state *state  = NULL;
-    int          logfile_flag          = 0; // no logging.
-    int          outpipe[2], errpipe[2] ;
-    int          ret;
+    union sigval v;
 
-    setprogname( argv[0] );
+    v.sival_int = ( step << 16 ) | ( errno & 0xffff );
+    sigqueue( motherpid, SIGEXECFAIL, v );
+}
 
-    if( !( config = init( argc, argv )  ) 
-     || !( state  =  makestate( config ) )
-     || !daemonize( ) ) /* initialize and daemonize */
-        exit( 8 );
+/*
+ * in the child, never returns.
+ */
+static void child( struct watcher_state *state, int outpipe[2], int errpipe[2] )
+{
+    const struct watcher_conf *config = state->config;
+    int         step;
+    sigset_t    none;
 
-#if defined( __linux__ )
-    // linux don't have setproctitle...
-    initproctitle( argc, argv );
-#endif
+    sigemptyset( &none );
+    sigprocmask( SIG_SETMASK, &none, NULL ); // SIGCHLD is blocked in watcher.
+    if( config->hardened ) harden_restore_oomadj( oomsaved );
 
-#if defined( sun ) && defined( __svr4__ )
-    ; // do nothing. so solaris doesn't allow change title.
-#else
-    setproctitle( "watcher_of_%s", config->progname );
-#endif
-    logfile_flag = ( config->logfile != NULL ) ;
+    if( config->place.flags != 0 && placement_apply( &( config->place ), state->index, &step ) < 0 )
+        childfail( step );
 
+    if( getuid() == 0 && config->uid != -1 ) setreuid( config->uid, config->uid );
+    if( getuid() == 0 && config->gid != -1 ) setregid( config->gid, config->gid );
 
-    /* main loop */
-    for(;; check_state( state, config->alert.region, config->alert.count )
-          ? sleep( config->sleeptime ) :  0 /* clear */)
+    signal( SIGUSR1, SIG_IGN );
+    if( outpipe != NULL ) // logging async mode.
     {
-        if( debugmode > 0 ) fprintf( stderr,"Loop...\n" );
+        close( outpipe[MOTHERSIDE]   ); 
+        dup2(  outpipe[CHILDSIDE], 1 );
+        close( outpipe[CHILDSIDE]    );
 
-        if( logfile_flag )
-        {
-            int flag ;
+        close( errpipe[MOTHERSIDE]   );
+        dup2(  errpipe[CHILDSIDE], 2 );  
+        close( errpipe[CHILDSIDE]    );
+    }
+    if( listenfd >= 0 )
+    {
+        listener_pass( listenfd );
+        fmtpid( state->pidslot + strlen( "LISTEN_PID=" ), getpid() );
+    }
+    if( state->shm != NULL ) // to the command, not to the other instances.
+    {
+        fcntl( state->shm->memfd, F_SETFD, 0 );
+        fcntl( state->shm->evfd,  F_SETFD, 0 );
+    }
 
-          // create stdout pipe
-            pipe( outpipe );
-            flag =  fcntl( outpipe[MOTHERSIDE], F_GETFL ); 
-            flag |= O_NONBLOCK ; 
-            fcntl( outpipe[MOTHERSIDE], F_SETFL, &flag );
+    execve( config->argv[0], config->argv, state->envp );
+    childfail( CHILD_EXEC );
+    _exit( 9 );/* error */
+}
 
-          // create stderr pipe
-            pipe( errpipe );
-            flag =  fcntl( errpipe[MOTHERSIDE], F_GETFL ); 
-            flag |= O_NONBLOCK ; 
-            fcntl( errpipe[MOTHERSIDE], F_SETFL, &flag );
-        }
+/*
+ * fork and exec an instance.
+ */
+static void spawn( struct watcher_state *state )
+{
+    const struct watcher_conf *config = state->config;
+    int          outpipe[2], errpipe[2] ;
+    pid_t        pid;
 
-        sigchildflag = 0; // clear
-        if(  childpid = fork() )
-        {
-            if( debugmode > 0 ) fprintf( stderr,"pid = %d\n", childpid );
-            if( childpid < 0 ) /* error */
-            {
-                perror( "fork" );
-                exit(0);
-                ;
-            }else{ /* parent */
-                if( debugmode >  0 )
-                    fprintf( stderr, "proccess %s [%d] execute.", 
-                            config->argv[0], childpid );
-                else
-                    syslog( LOG_INFO, "proccess %s [%d] execute.\n", 
-                            config->argv[0], childpid );
-
-                if( logfile_flag ) // logging, async mode.
-                {
-                    state->wstatus  = 0; // clear
-                    if( config->pidfile != NULL )
-                        writepidfile(config->pidfile, childpid );
-                    close( outpipe[CHILDSIDE] );
-                    close( errpipe[CHILDSIDE] );
-                    logging( config->logfile, outpipe[0], errpipe[0] );
-                    ret = wait(  &( state->wstatus ) );
-                    close( outpipe[MOTHERSIDE] );
-                    close( errpipe[MOTHERSIDE] );
-                    if( config->pidfile != NULL ) writepidfile(config->pidfile, 0 );
-                    if( debugmode > 0 ) 
-                        fprintf( stderr, "ret = %d (%d), errno = %d, status = %d, isExit = %s\n", 
-                                          ret, childpid, errno, state->wstatus, 
-                                          ( WIFEXITED( state->wstatus ) ) ? "YES" : "NO" );
-
-                }else{             // no logging, sync mode.
-
-                    do{
-                        state->wstatus  = 0; // clear
-                        if( config->pidfile != NULL )
-                            writepidfile(config->pidfile, childpid );
-                        ret = waitpid( childpid, &( state->wstatus ), 0 );
-                        if( config->pidfile != NULL ) writepidfile(config->pidfile, 0 );
-                        if( debugmode > 0 ) 
-                            fprintf( stderr, "ret = %d (%d), errno = %d, status = %d, isExit = %s\n", 
-                                              ret, childpid, errno, state->wstatus, 
-                                              ( WIFEXITED( state->wstatus ) ) ? "YES" : "NO" );
-                        if( ret < 0 )
-                        {
-                            continue; //FIXME
-                        }
-                    } while( ret < 0 || ! WIFEXITED( state->wstatus ) );
-                }
-                set_crashtime( state );
-                if( debugmode > 0 )
-                    fprintf( stderr, "proccess %s [%d] terminate.\n", 
-                                config->progname, childpid );
-                else
-                    syslog( LOG_INFO, "proccess %s [%d] terminate.", 
-                                config->progname, childpid );
-                sleep( 1 );
-            }
+    if( debugmode > 0 ) fprintf( stderr,"Loop...\n" );
+
+    if( pump != NULL )
+    {
+      // create stdout/stderr pipe, the child side is dup2()ed.
+        pipe2( outpipe, O_CLOEXEC );
+        pipe2( errpipe, O_CLOEXEC );
+    }
 
-        }else{ // pid == 0 ,child
+    state->starttime = journal_now( CLOCK_MONOTONIC );
+    state->wstatus   = 0; // clear
+    if( ( pid = fork() ) == 0 )
+    {
+        child( state, ( pump != NULL ) ? outpipe : NULL, errpipe );
+    }
 
-            if( getuid() == 0 && config->uid != -1 ) setreuid( config->uid, config->uid );
-            if( getuid() == 0 && config->gid != -1 ) setregid( config->gid, config->gid );
+    if( debugmode > 0 ) fprintf( stderr,"pid = %d\n", pid );
+    if( pid < 0 ) /* error, retry later */
+    {
+        if( debugmode > 0 )
+            perror( "fork" );
+        else
+            syslog( LOG_ERR, "can't fork %s%s, %m", config->progname, state->tag );
+        if( pump != NULL )
+        {
+            close( outpipe[MOTHERSIDE] ); close( outpipe[CHILDSIDE] );
+            close( errpipe[MOTHERSIDE] ); close( errpipe[CHILDSIDE] );
+        }
+        twheel_add( &wheel, &( state->restart ),
+                    state->starttime + config->sleeptime * RATE_SEC );
+        return ;
+    }
 
-            signal( SIGUSR1, SIG_IGN );
-            if( logfile_flag ) // logging async mode.
-            {
-                close( outpipe[MOTHERSIDE]   ); 
-                dup2(  outpipe[CHILDSIDE], 1 );
-                close( outpipe[CHILDSIDE]    );
+    state->pid = pid;
+    ring_watch( state );
+    if( state->due != 0 ) // restarted
+    {
+        int64_t d = journal_now( CLOCK_MONOTONIC ) - state->due;
 
-                close( errpipe[MOTHERSIDE]   );
-                dup2(  errpipe[CHILDSIDE], 2 );  
-                close( errpipe[CHILDSIDE]    );
-            }
+        restartlat.count ++;
+        restartlat.total += d;
+        if( d > restartlat.max ) restartlat.max = d;
+        state->due = 0;
+    }
+    if( debugmode >  0 )
+        fprintf( stderr, "proccess %s%s [%d] execute.", 
+                config->argv[0], state->tag, pid );
+    else
+        syslog( LOG_INFO, "proccess %s%s [%d] execute.\n", 
+                config->argv[0], state->tag, pid );
 
-            execv( config->argv[0], config->argv );
-            if( debugmode > 0 ) 
-                perror( "child" );
-            else
-                syslog( LOG_ERR, "%s [%d] execute fail,  %m", config->argv[0], getpid() );
-            kill( motherpid, SIGUSR1 );
-            exit( 9 );/* error */
+    if( pump != NULL ) // logging, pumped by the log threads.
+    {
+        struct logstream *out = NULL, *err = NULL, *shm = NULL;
+
+        close( outpipe[CHILDSIDE] );
+        close( errpipe[CHILDSIDE] );
+        if( fwd != NULL )
+        {
+            char ident[128];
+
+            // "name#index", no space in syslog tag.
+            snprintf( ident, sizeof( ident ), "%s%s", config->progname,
+                      state->tag + ( state->tag[0] == ' ' ) );
+            out = logfwd_stream( fwd, config->outprio, ident, pid );
+            err = logfwd_stream( fwd, config->errprio, ident, pid );
+            if( state->shm != NULL ) shm = logfwd_stream( fwd, config->outprio, ident, pid );
         }
+        if( state->tail != NULL )
+        {
+            crashtail_due( state->tail, debugmode ); // of the last one, not yet dumped.
+            crashtail_start( state->tail, pid );
+        }
+        state->outlp = logpump_add( pump, outpipe[MOTHERSIDE], logf, state->limit, out ? fwd : NULL, out, state->tail );
+        state->errlp = logpump_add( pump, errpipe[MOTHERSIDE], logf, state->limit, err ? fwd : NULL, err, state->tail );
+        if( state->shm != NULL ) // as stdout.
+            state->shmlp = logpump_add_shm( pump, state->shm, logf, state->limit, shm ? fwd : NULL, shm, state->tail );
+    }
+    if( config->pidfile != NULL ) writepidfile( config->pidfile );
+}
+
+/*
+ * on-demand activation ( -A ).
+ *   watcher holds the listener, and starts the instances on the first
+ *   connection. the connection is left in the queue and accepted by them.
+ *   they are stopped again after idletime without connections or output.
+ */
+#define PROBE_INTERVAL  1000000LL      /* 1msec */
+#define PROBE_LIMIT     ( 30 * RATE_SEC )
+
+static struct {
+    int      active;      /* instances are started */
+    int64_t  trigger;     /* the first connection came */
+    int64_t  lastactive;
+    uint64_t lastbytes;
+    int      starts;      /* cold start latency */
+    int64_t  total, max;
+    struct twheel_timer probe, idle;
+} lazy;
+
+static void lazy_listen( int on )
+{
+    struct epoll_event ev;
+
+    ev.events  = on ? EPOLLIN : 0;
+    ev.data.fd = listenfd;
+    epoll_ctl( epfd, EPOLL_CTL_MOD, listenfd, &ev );
+}
+
+static uint64_t output_bytes( void )
+{
+    uint64_t b = 0;
+    int      i;
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        if( states[i]->outlp != NULL ) b += logpump_bytes( states[i]->outlp );
+        if( states[i]->errlp != NULL ) b += logpump_bytes( states[i]->errlp );
+        if( states[i]->shmlp != NULL ) b += logpump_bytes( states[i]->shmlp );
+    }
+    return b;
+}
+
+static void lazy_start( void )
+{
+    const struct watcher_conf *config = states[0]->config;
+    int i;
+
+    if( lazy.active ) return ;
+
+    lazy.active     = 1;
+    lazy.trigger    = journal_now( CLOCK_MONOTONIC );
+    lazy.lastactive = lazy.trigger;
+    lazy_listen( 0 ); // the instances take it over.
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        if( states[i]->pid == 0 && !twheel_armed( &( states[i]->restart ) ) ) spawn( states[i] );
+    }
+    lazy.lastbytes = output_bytes();
+    twheel_add( &wheel, &lazy.probe, lazy.trigger + PROBE_INTERVAL );
+    if( config->idletime > 0 )
+        twheel_add( &wheel, &lazy.idle, lazy.trigger + config->idletime * RATE_SEC );
+}
+
+/*
+ * cold start latency : until the first connection is accepted.
+ */
+static void probe_timer( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    const struct watcher_conf *config = states[0]->config;
+    int64_t now = journal_now( CLOCK_MONOTONIC ), d;
+
+    if( listener_pending( listenfd ) )
+    {
+        if( now - lazy.trigger < PROBE_LIMIT ) twheel_add( w, t, now + PROBE_INTERVAL );
+        return ;
+    }
+    d = now - lazy.trigger;
+    lazy.starts ++;
+    lazy.total += d;
+    if( d > lazy.max ) lazy.max = d;
+
+    if( debugmode > 0 )
+        fprintf( stderr, "cold start of %s took %.3f msec ( avg %.3f, max %.3f, %d starts ).\n",
+                 config->progname, d / 1e6, lazy.total / 1e6 / lazy.starts, lazy.max / 1e6, lazy.starts );
+    else
+        syslog( LOG_INFO, "cold start of %s took %.3f msec ( avg %.3f, max %.3f, %d starts ).",
+                config->progname, d / 1e6, lazy.total / 1e6 / lazy.starts, lazy.max / 1e6, lazy.starts );
+}
+
+static void idle_timer( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    const struct watcher_conf *config = states[0]->config;
+    int64_t  now  = journal_now( CLOCK_MONOTONIC );
+    int64_t  idle = config->idletime * RATE_SEC;
+    uint64_t bytes = output_bytes();
+    int      i;
+
+    // sampled every idletime/4, short connections in between may be missed.
+    if( bytes != lazy.lastbytes
+     || listener_pending( listenfd ) || listener_connections( listenfd ) > 0 )
+    {
+        lazy.lastactive = now;
+        lazy.lastbytes  = bytes;
+    }
+    if( now - lazy.lastactive < idle )
+    {
+        twheel_add( w, t, now + ( idle / 4 > RATE_SEC ? idle / 4 : RATE_SEC ) );
+        return ;
+    }
+
+    if( debugmode > 0 )
+        fprintf( stderr, "%s is idle for %d sec, stopping.\n", config->progname, (int)config->idletime );
+    else
+        syslog( LOG_INFO, "%s is idle for %d sec, stopping.", config->progname, (int)config->idletime );
+
+    twheel_cancel( w, &lazy.probe );
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        twheel_cancel( w, &( states[i]->restart ) );
+        if( states[i]->pid > 0 )
+        {
+            states[i]->stopping = 1;
+            kill( states[i]->pid, SIGTERM );
+        }
+    }
+    lazy_stopped();
+}
+
+/*
+ * all instances are stopped, wait for the next connection.
+ */
+static void lazy_stopped( void )
+{
+    int i;
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        if( states[i]->pid > 0 ) return ;
+    }
+    lazy.active = 0;
+    lazy_listen( 1 );
+}
+
+/*
+ * pressure aware restarts ( -Q ).
+ *   while the host is under pressure, restarts of non-critical instances
+ *   are held, and released one by one, oldest first, when it is over.
+ *   critical ones ( -I ) are restarted as usual, ahead of them.
+ */
+#define PSI_STAGGER   RATE_SEC              /* between released restarts */
+#define PSI_MAXHOLD   ( 300 * RATE_SEC )    /* released anyway */
+
+static struct {
+    int      nheld;
+    int      held, forced;  /* restarts held, released under pressure */
+    int64_t  total, max;    /* held, nsec */
+    struct twheel_timer stagger;
+} pressure;
+
+static void hold( struct watcher_state *state, const char *what, int64_t now )
+{
+    char reason[256];
+
+    if( what != NULL )
+        snprintf( reason, sizeof( reason ), "%s pressure", what );
+    else
+        snprintf( reason, sizeof( reason ), "behind %d held", pressure.nheld );
+
+    state->held = now;
+    pressure.nheld ++;
+    pressure.held ++;
+    if( debugmode > 0 )
+        fprintf( stderr, "restart of %s%s held, %s.\n", state->config->progname, state->tag, reason );
+    else
+        syslog( LOG_NOTICE, "restart of %s%s held, %s.", state->config->progname, state->tag, reason );
+
+    if( !twheel_armed( &pressure.stagger ) ) twheel_add( &wheel, &pressure.stagger, now + PSI_STAGGER );
+}
+
+/*
+ * the restart is due ( supervisor ).
+ */
+static void restart( struct supervisor *s, struct watcher_state *state )
+{
+    const char *what = NULL;
+    int64_t     now;
+
+    if( psi != NULL && !state->config->critical )
+    {
+        now = journal_now( CLOCK_MONOTONIC );
+        // behind the held ones, even if the pressure is over.
+        if( pressure.nheld > 0 || psi_pressured( psi, now, &what ) )
+        {
+            hold( state, what, now );
+            return ;
+        }
+    }
+    spawn( state );
+}
+
+static void stagger_timer( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    struct watcher_state *state = NULL;
+    const char *what;
+    int64_t     now = journal_now( CLOCK_MONOTONIC ), d;
+    int         i, forced;
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        if( states[i]->held != 0 && ( state == NULL || states[i]->held < state->held ) ) state = states[i];
+    }
+    if( state == NULL ) return ;
+
+    d      = now - state->held;
+    forced = psi_pressured( psi, now, &what );
+    if( forced && d < PSI_MAXHOLD )
+    {
+        twheel_add( w, t, now + PSI_STAGGER );
+        return ;
+    }
+
+    state->held = 0;
+    pressure.nheld --;
+    pressure.total += d;
+    if( d > pressure.max ) pressure.max = d;
+    // started meanwhile ( -A ), or stopped for idle.
+    if( state->pid == 0 && !( state->config->lazy && !lazy.active ) )
+    {
+        if( forced ) pressure.forced ++;
+        if( debugmode > 0 )
+            fprintf( stderr, "restart of %s%s released after %.1f sec%s.\n", state->config->progname,
+                     state->tag, d / 1e9, forced ? ", still under pressure" : "" );
+        else
+            syslog( LOG_NOTICE, "restart of %s%s released after %.1f sec%s.", state->config->progname,
+                    state->tag, d / 1e9, forced ? ", still under pressure" : "" );
+        state->due = now; // the latency is of the restart path, not of the hold.
+        spawn( state );
+    }
+    if( pressure.nheld > 0 ) twheel_add( w, t, now + PSI_STAGGER );
+}
+
+static int64_t monotonic( struct supervisor *s )
+{
+    return journal_now( CLOCK_MONOTONIC );
+}
+
+static void supervisor_log( struct supervisor *s, int prio, const char *msg )
+{
+    if( debugmode > 0 )
+        fprintf( stderr, "%s\n", msg );
+    else
+        syslog( prio, "%s", msg );
+}
+
+static const struct supervisor_ops watcher_ops = { monotonic, restart, supervisor_log };
+
+/*
+ * the instance terminated. schedule the restart.
+ */
+static void terminated( struct watcher_state *state, int wstatus, const struct rusage *ru )
+{
+    const struct watcher_conf *config = state->config;
+    int64_t now   = journal_now( CLOCK_MONOTONIC );
+
+    state->wstatus = wstatus;
+    if( state->pidfd >= 0 ) // its poll completes, the process is gone.
+    {
+        close( state->pidfd );
+        state->pidfd  = -1;
+        state->polled = 0;
+    }
+    if( state->tail != NULL ) // dumped when the pipes are drained.
+        crashtail_exit( state->tail, wstatus, now - state->starttime, ru,
+                        ( state->outlp != NULL ) ? 2 + ( state->shmlp != NULL ) : 0,
+                        !state->stopping && ( WIFSIGNALED( wstatus ) || WEXITSTATUS( wstatus ) != 0 ),
+                        debugmode );
+    if( debugmode > 0 ) 
+        fprintf( stderr, "ret = %d, status = %d, isExit = %s\n", 
+                          state->pid, state->wstatus, 
+                          ( WIFEXITED( state->wstatus ) ) ? "YES" : "NO" );
+
+    if( state->outlp != NULL ) // the rest is drained by the log threads.
+    {
+        logpump_detach( pump, state->outlp );
+        logpump_detach( pump, state->errlp );
+        if( state->shmlp != NULL ) logpump_detach( pump, state->shmlp );
+        state->outlp = state->errlp = state->shmlp = NULL;
+    }
+
+    if( state->stopping ) // stopped by watcher, not a crash.
+    {
+        record_state( state, state->pid );
+        if( debugmode > 0 )
+            fprintf( stderr, "proccess %s%s [%d] stopped.\n", 
+                        config->progname, state->tag, state->pid );
+        else
+            syslog( LOG_INFO, "proccess %s%s [%d] stopped.", 
+                        config->progname, state->tag, state->pid );
+        state->pid      = 0;
+        state->stopping = 0;
+        if( config->pidfile != NULL ) writepidfile( config->pidfile );
+        lazy_stopped();
+        return ;
+    }
+
+    record_state( state, state->pid );
+    if( debugmode > 0 )
+        fprintf( stderr, "proccess %s%s [%d] terminate.\n", 
+                    config->progname, state->tag, state->pid );
+    else
+        syslog( LOG_INFO, "proccess %s%s [%d] terminate.", 
+                    config->progname, state->tag, state->pid );
+    state->pid = 0;
+    if( config->pidfile != NULL ) writepidfile( config->pidfile );
+
+    supervise_exited( &sv, state );
+}
+
+/*
+ * counters, on SIGUSR2.
+ */
+static void report( void )
+{
+    const struct watcher_conf *config = states[0]->config;
+    char   buff[1024];
+    int    i;
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        struct shmlog   *shm = states[i]->shm;
+        struct loglimit *l   = states[i]->limit;
+        int n = snprintf( buff, sizeof( buff ), "%s%s : pid %d, %llu bytes logged",
+                  states[i]->config->progname, states[i]->tag, states[i]->pid,
+                  ( states[i]->outlp == NULL ) ? 0ULL :
+                  (unsigned long long)( logpump_bytes( states[i]->outlp ) + logpump_bytes( states[i]->errlp ) ) );
+
+        if( shm != NULL ) // since watcher started.
+            n += snprintf( buff + n, sizeof( buff ) - n, ", %llu bytes by shared memory, %llu dropped",
+                      (unsigned long long)__atomic_load_n( &( shm->h->head ), __ATOMIC_RELAXED ),
+                      (unsigned long long)__atomic_load_n( &( shm->h->dropped ), __ATOMIC_RELAXED ) );
+        if( l != NULL )
+        {
+            pthread_mutex_lock( &( l->lock ) );
+            n += snprintf( buff + n, sizeof( buff ) - n, ", %llu lines / %llu bytes suppressed in %d periods%s",
+                      (unsigned long long)l->stat.slines, (unsigned long long)l->stat.sbytes,
+                      l->stat.periods, ( l->since != 0 ) ? " ( throttled now )" : "" );
+            pthread_mutex_unlock( &( l->lock ) );
+        }
+        snprintf( buff + n, sizeof( buff ) - n, "." );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    if( graph != NULL && depgraph_done( graph ) )
+    {
+        int n = snprintf( buff, sizeof( buff ), "critical path : " );
+
+        depgraph_critical( graph, buff + n, sizeof( buff ) - n );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    snprintf( buff, sizeof( buff ), "main loop of %s : %s, %llu waits.", config->progname,
+              ( mainloop.u != NULL ) ? "io_uring" : "epoll",
+              (unsigned long long)( ( mainloop.u != NULL ) ? mainloop.u->enters : mainloop.waits ) );
+    if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    if( restartlat.count > 0 )
+    {
+        snprintf( buff, sizeof( buff ), "%s : %d restarts, latency avg %.3f msec, max %.3f msec.",
+                  config->progname, restartlat.count,
+                  restartlat.total / 1e6 / restartlat.count, restartlat.max / 1e6 );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    if( psi != NULL )
+    {
+        int n = snprintf( buff, sizeof( buff ), "pressure :" );
+
+        for( i = 0 ; i < psi->n && n < (int)sizeof( buff ) ; i ++ )
+            n += snprintf( buff + n, sizeof( buff ) - n, " %s %u%s,", psi->t[i].name, psi->t[i].events,
+                           ( psi->t[i].fd < 0 ) ? " ( polled )" : "" );
+        if( n < (int)sizeof( buff ) )
+            snprintf( buff + n, sizeof( buff ) - n, " %d restarts held ( %d now ), %d released under pressure,"
+                      " avg %.1f sec, max %.1f sec.", pressure.held, pressure.nheld, pressure.forced,
+                      ( pressure.held > pressure.nheld ) ? pressure.total / 1e9 / ( pressure.held - pressure.nheld ) : 0.0,
+                      pressure.max / 1e9 );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    if( config->hardened )
+    {
+        long lck, rss = harden_rss( &lck );
+
+        snprintf( buff, sizeof( buff ), "watcher of %s : rss %ld kB, locked %ld kB.",
+                  config->progname, rss, lck );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    if( pump != NULL )
+    {
+        uint64_t waits = 0, reads = 0, chunks = 0;
+
+        for( i = 0 ; i < pump->nworkers ; i ++ )
+        {
+            waits  += pump->workers[i].waits;
+            reads  += pump->workers[i].reads;
+            chunks += pump->workers[i].chunks;
+        }
+        snprintf( buff, sizeof( buff ), "log threads of %s : %d of %d on io_uring%s, %llu waits, %llu reads, %llu chunks.",
+                  config->progname, pump->uring, pump->nworkers, pump->multishot ? " ( multishot )" : "",
+                  (unsigned long long)waits, (unsigned long long)reads, (unsigned long long)chunks );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    if( fwd != NULL )
+    {
+        pthread_mutex_lock( &( fwd->lock ) );
+        snprintf( buff, sizeof( buff ), "forward of %s : %llu lines sent, %llu dropped, %d queued.",
+                  config->progname, (unsigned long long)fwd->sent,
+                  (unsigned long long)fwd->dropped, fwd->count );
+        pthread_mutex_unlock( &( fwd->lock ) );
+        if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+    }
+    if( logf == NULL ) return ;
+
+    pthread_mutex_lock( &( logf->lock ) );
+    snprintf( buff, sizeof( buff ), "log of %s : %llu bytes written, %llu slow subscribers dropped.",
+              config->progname, (unsigned long long)logf->stat.bytes,
+              (unsigned long long)__atomic_load_n( &( pump->dropped ), __ATOMIC_RELAXED ) );
+    pthread_mutex_unlock( &( logf->lock ) );
+    if( debugmode > 0 ) fprintf( stderr, "%s\n", buff ); else syslog( LOG_INFO, "%s", buff );
+}
+
+/*
+ * crash tails drained by the log threads, dump them here.
+ */
+static void crashdue( void )
+{
+    uint64_t cnt;
+    int      i;
+
+    read( pump->notify, &cnt, sizeof( cnt ) );
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        if( states[i]->tail != NULL ) crashtail_due( states[i]->tail, debugmode );
+    }
+}
+
+/*
+ * services ( -C ). start what can be started now.
+ */
+static void depstart( void )
+{
+    int64_t now = journal_now( CLOCK_MONOTONIC );
+    int     i;
+
+    while( ( i = depgraph_next( graph ) ) >= 0 )
+    {
+        depgraph_started( graph, i, now );
+        spawn( states[i] );
+        twheel_add( &wheel, &( states[i]->ready ), now ); // first probe on the next tick
+    }
+}
+
+static void ready_timer( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    struct watcher_state *state = arg;
+    struct depservice    *s = &( graph->svc[ state->index ] );
+    int64_t now = journal_now( CLOCK_MONOTONIC );
+    char    buff[1024];
+
+    if( state->pid == 0 || !depgraph_probe( s, state->starttime, now ) )
+    {
+        if( now - s->started < READY_WARN && now + READY_POLL - s->started >= READY_WARN )
+        {
+            if( debugmode > 0 )
+                fprintf( stderr, "service %s is not ready for %d sec.\n", s->name, (int)( READY_WARN / RATE_SEC ) );
+            else
+                syslog( LOG_WARNING, "service %s is not ready for %d sec.", s->name, (int)( READY_WARN / RATE_SEC ) );
+        }
+        twheel_add( w, t, now + READY_POLL );
+        return ;
+    }
+    depgraph_ready( graph, state->index, now );
+    if( debugmode > 0 )
+        fprintf( stderr, "service %s ready in %.3f sec.\n", s->name, ( now - s->started ) / 1e9 );
+    else
+        syslog( LOG_INFO, "service %s ready in %.3f sec.", s->name, ( now - s->started ) / 1e9 );
+
+    depstart();
+    if( depgraph_done( graph ) )
+    {
+        int msec = depgraph_critical( graph, buff, sizeof( buff ) );
+
+        if( debugmode > 0 )
+            fprintf( stderr, "all %d services ready in %.3f sec, critical path : %s\n", graph->n, msec / 1e3, buff );
+        else
+            syslog( LOG_INFO, "all %d services ready in %.3f sec, critical path : %s", graph->n, msec / 1e3, buff );
+    }
+}
+
+/*
+ * private method: config of a service, the rest is as watcher's.
+ */
+static struct watcher_conf *serviceconf( const struct watcher_conf *config, const struct depservice *s )
+{
+    struct watcher_conf *c;
+    int i;
+
+    c = malloc( sizeof( struct watcher_conf ) + fixsize( s->argc +2 ) * sizeof( char * ) );
+    if( c == NULL ) return NULL;
+
+   *c = *config;
+    c->progname  = s->name;
+    c->critical  = s->critical;
+    c->instances = 1;
+    if( config->journal != NULL ) // journal.name, the history follows the name.
+    {
+        if( ( c->journal = malloc( strlen( config->journal ) + strlen( s->name ) + 2 ) ) == NULL )
+        {
+            free( c );
+            return NULL;
+        }
+        sprintf( c->journal, "%s.%s", config->journal, s->name );
+    }
+    for( i = 0 ; i < s->argc ; i ++ ) c->argv[i] = s->argv[i];
+    c->argv[i] = NULL;
+    c->argc    = i;
+    return c;
+}
+
+/*
+ * hardened mode ( -M ), after everything else is allocated.
+ */
+static void harden( const struct watcher_conf *config )
+{
+    long rss, lck;
+
+    // a pipe may be still draining when the next one is added, 2 of each stream.
+    if( ( pump != NULL && logpump_reserve( pump, ( config->shmlog ? 6 : 4 ) * nstates ) < 0 )
+     || ( fwd  != NULL && logfwd_reserve( fwd, ( config->shmlog ? 6 : 4 ) * nstates ) < 0 )
+     || harden_heap( HARDEN_HEAP ) < 0 )
+    {
+        syslog( LOG_ERR, "can't preallocate memory, %m" );
+        exit( 8 );
+    }
+    if( harden_lock() < 0 )
+        syslog( LOG_WARNING, "can't lock memory, %m" );
+    if( harden_oomadj( HARDEN_OOMADJ, oomsaved, sizeof( oomsaved ) ) < 0 )
+        syslog( LOG_WARNING, "can't set oom_score_adj, %m" );
+
+    rss = harden_rss( &lck );
+    if( debugmode > 0 )
+        fprintf( stderr, "hardened, rss %ld kB, locked %ld kB.\n", rss, lck );
+    else
+        syslog( LOG_INFO, "hardened, rss %ld kB, locked %ld kB.", rss, lck );
+}
+
+/*
+ * SIGEXECFAIL : a step of the instance failed before exec, or exec.
+ *   code : step << 16 | errno, by childfail().
+ */
+static void execfailed( pid_t pid, int code )
+{
+    int step = code >> 16, err = code & 0xffff, i;
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        const struct watcher_conf *config = states[i]->config;
+
+        if( states[i]->pid != pid ) continue;
+
+        if( step != CHILD_EXEC ) // placement, exec goes on.
+        {
+            if( debugmode > 0 )
+                fprintf( stderr, "%s [%d] can't set %s, %s\n", config->argv[0], pid,
+                                 placement_step( step ), strerror( err ) );
+            else
+                syslog( LOG_WARNING, "%s [%d] can't set %s, %s", config->argv[0], pid,
+                                     placement_step( step ), strerror( err ) );
+            return ;
+        }
+        if( debugmode > 0 )
+            fprintf( stderr, "%s [%d] execute fail, %s\n", config->argv[0], pid, strerror( err ) );
+        else
+            syslog( LOG_ERR, "%s [%d] execute fail, %s", config->argv[0], pid, strerror( err ) );
+
+        states[i]->execfail = 1;
+        if( ++ states[i]->execerr > 3 )
+        {
+            if( debugmode > 0 )
+                fprintf( stderr, "exec fail too many, terminate.\n" );
+            else
+                syslog( LOG_ERR, "exec fail too many, terminate." );
+            exit( 1 );
+        }
+        return ;
+    }
+}
+
+static void readsig( int sigfd )
+{
+    struct signalfd_siginfo si;
+
+    while( read( sigfd, &si, sizeof( si ) ) > 0 )
+    {
+        if( si.ssi_signo == SIGEXECFAIL ) execfailed( si.ssi_pid, si.ssi_int );
+        if( si.ssi_signo == SIGUSR2 ) report();
+    }
+}
+
+/*
+ * SIGCHLD, SIGEXECFAIL and SIGUSR2 by signalfd.
+ */
+static void reap( int sigfd )
+{
+    struct rusage ru;
+    int    wstatus, i;
+    pid_t  pid;
+
+    readsig( sigfd );
+    while( ( pid = wait4( -1, &wstatus, WNOHANG, &ru ) ) > 0 )
+    {
+        readsig( sigfd ); // SIGEXECFAIL of pid was sent before it exited.
+        for( i = 0 ; i < nstates ; i ++ )
+        {
+            if( states[i]->pid == pid )
+            {
+                terminated( states[i], wstatus, &ru );
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * private method: the ready fds of the main loop.
+ */
+static void dispatch( const struct epoll_event *evs, int n, int sigfd )
+{
+    int i;
+
+    for( i = 0 ; i < n ; i ++ )
+    {
+        if( evs[i].data.fd == wheel.fd ) twheel_dispatch( &wheel );
+        else if( evs[i].data.fd == sigfd ) reap( sigfd );
+        else if( evs[i].data.fd == listenfd ) lazy_start();
+        else if( evs[i].data.fd == tapfd ) logtap_accept( tapfd, pump );
+        else if( pump != NULL && evs[i].data.fd == pump->notify ) crashdue();
+        else if( psi != NULL )
+            psi_event( psi, evs[i].data.fd, evs[i].events, journal_now( CLOCK_MONOTONIC ) );
+    }
+}
+
+/*
+ * the main loop on io_uring ( -U ).
+ *   an exit of the child is a poll of its pidfd, the timer wheel is a
+ *   timeout op, and the rest ( signalfd, listener, tap, pressure ) stays
+ *   on epfd, polled by the ring too. one io_uring_enter() a round.
+ */
+#define RING_ENTRIES  64
+#define UD_EPOLL      1ULL
+#define UD_CHILD      2ULL
+#define UD_TIMER      ( 1ULL << 63 )  /* | deadline */
+
+static int pidfd_open( pid_t pid )
+{
+#ifdef __NR_pidfd_open
+    return syscall( __NR_pidfd_open, pid, 0 ); // always close-on-exec.
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * private method: the ring of the main loop, NULL if the kernel can't.
+ */
+static struct uring *ring_open( void )
+{
+    struct uring *u;
+    int    fd;
+
+    if( ( fd = pidfd_open( getpid() ) ) < 0 ) return NULL;
+    close( fd );
+    if( !( u = calloc( 1, sizeof( *u ) ) ) ) return NULL;
+    if( uring_init( u, RING_ENTRIES ) < 0 )
+    {
+        free( u );
+        return NULL;
+    }
+    if( !uring_supported( u, IORING_OP_POLL_ADD ) || !uring_supported( u, IORING_OP_TIMEOUT ) )
+    {
+        uring_exit( u );
+        free( u );
+        return NULL;
+    }
+    return u;
+}
+
+/*
+ * private method: poll the pidfd of the child, or mark it for the next round.
+ */
+static void ring_poll( struct watcher_state *state )
+{
+    struct io_uring_sqe *sqe;
+
+    if( state->pidfd < 0 || state->polled ) return ;
+    if( ( sqe = uring_sqe( mainloop.u ) ) == NULL )
+    {
+        mainloop.unpolled = 1;
+        return ;
+    }
+    sqe->opcode      = IORING_OP_POLL_ADD;
+    sqe->fd          = state->pidfd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data   = UD_CHILD;
+    state->polled    = 1;
+}
+
+/*
+ * the child is forked. without a pidfd, SIGCHLD comes by signalfd again.
+ */
+static void ring_watch( struct watcher_state *state )
+{
+    if( mainloop.u == NULL ) return ;
+
+    if( ( state->pidfd = pidfd_open( state->pid ) ) < 0 )
+    {
+        if( sigismember( &( mainloop.mask ), SIGCHLD ) ) return ;
+        if( debugmode > 0 )
+            fprintf( stderr, "can't open pidfd of %s%s, %s. SIGCHLD instead.\n",
+                     state->config->progname, state->tag, strerror( errno ) );
+        else
+            syslog( LOG_WARNING, "can't open pidfd of %s%s, %m. SIGCHLD instead.",
+                    state->config->progname, state->tag );
+        sigaddset( &( mainloop.mask ), SIGCHLD );
+        signalfd( mainloop.sigfd, &( mainloop.mask ), 0 );
+        return ;
+    }
+    ring_poll( state );
+}
+
+/*
+ * private method: arm the timeout op, if the wheel has earlier work than it.
+ */
+static void ring_timer( void )
+{
+    static struct __kernel_timespec ts; // read by the kernel at the submit.
+    struct io_uring_sqe *sqe;
+    int64_t next = twheel_next( &wheel );
+
+    if( next < 0 || ( mainloop.armed >= 0 && next >= mainloop.armed ) ) return ;
+    if( ( sqe = uring_sqe( mainloop.u ) ) == NULL ) return ; // next round.
+
+    ts.tv_sec  = next / RATE_SEC;
+    ts.tv_nsec = next % RATE_SEC;
+    sqe->opcode        = IORING_OP_TIMEOUT;
+    sqe->fd            = -1;
+    sqe->addr          = (uint64_t)(uintptr_t)&ts;
+    sqe->len           = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS; // CLOCK_MONOTONIC, as the wheel.
+    sqe->user_data     = UD_TIMER | (uint64_t)next;
+    mainloop.armed     = next;
+}
+
+static void ring_loop( void )
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct epoll_event   evs[16];
+    uint64_t ud;
+    int      i, n, exited;
+
+    for(;;)
+    {
+        if( !mainloop.epoll && ( sqe = uring_sqe( mainloop.u ) ) != NULL )
+        {
+            sqe->opcode      = IORING_OP_POLL_ADD;
+            sqe->fd          = epfd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data   = UD_EPOLL;
+            mainloop.epoll   = 1;
+        }
+        if( mainloop.unpolled )
+        {
+            mainloop.unpolled = 0;
+            for( i = 0 ; i < nstates ; i ++ ) ring_poll( states[i] );
+        }
+        ring_timer();
+
+        if( uring_enter( mainloop.u, 1, -1 ) < 0 )
+        {
+            syslog( LOG_ERR, "main loop, io_uring_enter(), %m" );
+            continue;
+        }
+        for( exited = 0 ; ( cqe = uring_cqe( mainloop.u ) ) != NULL ; )
+        {
+            ud = cqe->user_data;
+            uring_cqe_seen( mainloop.u );
+
+            if( ud & UD_TIMER ) // a stale one, if armed earlier since.
+            {
+                if( (int64_t)( ud & ~UD_TIMER ) == mainloop.armed ) mainloop.armed = -1;
+            }
+            else if( ud == UD_CHILD ) exited = 1;
+            else if( ud == UD_EPOLL )
+            {
+                mainloop.epoll = 0;
+                if( ( n = epoll_wait( epfd, evs, 16, 0 ) ) > 0 ) dispatch( evs, n, mainloop.sigfd );
+            }
+        }
+        if( exited ) reap( mainloop.sigfd ); // all of them by one wait4() loop.
+        twheel_advance( &wheel, journal_now( CLOCK_MONOTONIC ) );
+    }
+}
+
+/*
+ * private method: the journal, or exit. locked, another watcher on it is an error.
+ */
+static struct journal *openjournal( const char *path )
+{
+    struct journal *j = journal_open( path, JOURNAL_SLOTS, 1 );
+
+    if( j == NULL )
+    {
+        fprintf( stderr, "can't open journal '%s', %s\n", path,
+                 ( errno == EWOULDBLOCK ) ? "used by another watcher" : strerror( errno ) );
+        exit( 8 );
+    }
+    return j;
+}
+
+/*
+ * at exit, synced and unlocked. instances of a pool share one.
+ */
+static void closejournals( void )
+{
+    int i;
+
+    for( i = 0 ; i < nstates ; i ++ )
+    {
+        if( states[i]->journal == NULL ) continue;
+        if( i + 1 == nstates || states[i + 1]->journal != states[i]->journal )
+            journal_close( states[i]->journal );
+    }
+}
+
+int main (int argc, char *argv[] )
+{
+    const struct watcher_conf  *config = NULL;
+    struct       journal       *journal = NULL;
+    struct epoll_event          ev, evs[16];
+    sigset_t                    mask;
+    int                         sigfd;
+    int                         i, n;
+
+    setprogname( argv[0] );
+
+    if( !( config = init( argc, argv ) ) ) exit( 8 );
+    supervise_init( &sv, &watcher_ops, NULL, &wheel );
+    sv.debug = debugmode;
+
+    if( config->services == NULL && config->journal != NULL ) journal = openjournal( config->journal );
+    if( config->listen != NULL
+     && ( listenfd = listener_open( config->listen, LISTENER_BACKLOG ) ) < 0 )
+    {
+        fprintf( stderr, "can't listen on '%s', %s\n", 
+                         config->listen, strerror( errno ) );
+        exit( 8 );
+    }
+
+    if( config->tap != NULL && ( tapfd = logtap_open( config->tap ) ) < 0 )
+    {
+        fprintf( stderr, "can't open tap socket '%s', %s\n", 
+                         config->tap, strerror( errno ) );
+        exit( 8 );
+    }
+
+    if( config->services != NULL ) // a state for each service.
+    {
+        char err[256];
+
+        if( !( graph = depgraph_load( config->services, err, sizeof( err ) ) ) )
+        {
+            fprintf( stderr, "%s\n", err );
+            exit( 8 );
+        }
+        graph->limit = config->parallel;
+        states = calloc( sizeof( struct watcher_state * ), graph->n );
+        if( states == NULL ) exit( 8 );
+        for( nstates = 0 ; nstates < graph->n ; nstates ++ )
+        {
+            struct watcher_conf *c = serviceconf( config, &( graph->svc[nstates] ) );
+
+            if( c == NULL ) exit( 8 );
+            journal = ( c->journal != NULL ) ? openjournal( c->journal ) : NULL;
+            if( !( states[nstates] = makestate( c, nstates, journal ) ) ) exit( 8 );
+            twheel_timer_init( &( states[nstates]->ready ), ready_timer, states[nstates] );
+        }
+    }
+    else
+    {
+        states = calloc( sizeof( struct watcher_state * ), config->instances );
+        if( states == NULL ) exit( 8 );
+        for( nstates = 0 ; nstates < config->instances ; nstates ++ )
+        {
+            if( !( states[nstates] = makestate( config, nstates, journal ) ) ) exit( 8 );
+        }
+    }
+
+    if( !daemonize( ) ) /* initialize and daemonize */
+        exit( 8 );
+    motherpid = getpid();
+    atexit( closejournals );
+
+    // -U, the main loop on io_uring. the ring drives the timer wheel then.
+    if( config->uring && !( mainloop.u = ring_open() ) )
+    {
+        if( debugmode > 0 )
+            fprintf( stderr, "main loop on epoll, the kernel can't io_uring it.\n" );
+        else
+            syslog( LOG_NOTICE, "main loop on epoll, the kernel can't io_uring it." );
+    }
+    if( twheel_init( &wheel, TWHEEL_TICK, journal_now( CLOCK_MONOTONIC ), mainloop.u == NULL ) < 0 )
+        exit( 8 );
+
+#if defined( __linux__ )
+    // linux don't have setproctitle...
+    initproctitle( argc, argv );
+#endif
+
+#if defined( sun ) && defined( __svr4__ )
+    ; // do nothing. so solaris doesn't allow change title.
+#else
+    setproctitle( "watcher_of_%s", config->progname );
+#endif
+
+    // SIGCHLD, SIGEXECFAIL and SIGUSR2 come by signalfd. blocked before the log threads start.
+    sigemptyset( &mask );
+    sigaddset( &mask, SIGCHLD );
+    sigaddset( &mask, SIGEXECFAIL );
+    sigaddset( &mask, SIGUSR2 );
+    sigprocmask( SIG_BLOCK, &mask, NULL );
+    if( mainloop.u != NULL ) sigdelset( &mask, SIGCHLD ); // by pidfd, left pending.
+    sigfd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC );
+    epfd  = epoll_create1( EPOLL_CLOEXEC );
+    if( sigfd < 0 || epfd < 0 ) exit( 8 );
+    mainloop.sigfd = sigfd;
+    mainloop.mask  = mask;
+    mainloop.armed = -1;
+
+    ev.events = EPOLLIN;
+    if( wheel.fd >= 0 )
+    {
+        ev.data.fd = wheel.fd;
+        epoll_ctl( epfd, EPOLL_CTL_ADD, wheel.fd, &ev );
+    }
+    ev.data.fd = sigfd;
+    epoll_ctl( epfd, EPOLL_CTL_ADD, sigfd, &ev );
+
+    if( config->logfile != NULL || config->forward || config->tailsize > 0 || config->shmlog > 0 )
+    {
+        if( ( config->logfile != NULL && !( logf = logfile_new( config->logfile ) ) )
+         || ( config->forward && !( fwd = logfwd_start( config->forward ) ) )
+         || !( pump = logpump_start( config->logworkers, debugmode,
+                     cpumask_count( &( config->housekeeping ) ) ? &( config->housekeeping ) : NULL,
+                     config->uring ) ) )
+        {
+            syslog( LOG_ERR, "can't start logging threads, %m" );
+            exit( 8 );
+        }
+        if( tapfd >= 0 )
+        {
+            ev.events  = EPOLLIN;
+            ev.data.fd = tapfd;
+            epoll_ctl( epfd, EPOLL_CTL_ADD, tapfd, &ev );
+        }
+        ev.events  = EPOLLIN;
+        ev.data.fd = pump->notify;
+        epoll_ctl( epfd, EPOLL_CTL_ADD, pump->notify, &ev );
+    }
+
+    if( psi != NULL )
+    {
+        const char *what;
+        int         armed = psi_arm( psi, journal_now( CLOCK_MONOTONIC ), &what );
+
+        if( armed < 0 )
+        {
+            syslog( LOG_ERR, "can't read pressure of '%s', %m", what );
+            exit( 8 );
+        }
+        for( i = 0 ; i < psi->n ; i ++ )
+        {
+            if( psi->t[i].fd < 0 ) continue;
+            ev.events  = EPOLLPRI;
+            ev.data.fd = psi->t[i].fd;
+            epoll_ctl( epfd, EPOLL_CTL_ADD, psi->t[i].fd, &ev );
+        }
+        if( armed < psi->n )
+        {
+            if( debugmode > 0 )
+                fprintf( stderr, "%d of %d pressure triggers refused, polled instead.\n", psi->n - armed, psi->n );
+            else
+                syslog( LOG_NOTICE, "%d of %d pressure triggers refused, polled instead.", psi->n - armed, psi->n );
+        }
+        twheel_timer_init( &pressure.stagger, stagger_timer, NULL );
+    }
+
+    if( config->hardened ) harden( config );
+
+    if( graph != NULL ) // services, in dependency order.
+    {
+        depstart();
+    }
+    else if( config->lazy ) // on-demand, wait for the first connection.
+    {
+        twheel_timer_init( &lazy.probe, probe_timer, NULL );
+        twheel_timer_init( &lazy.idle,  idle_timer,  NULL );
+        ev.events  = EPOLLIN;
+        ev.data.fd = listenfd;
+        epoll_ctl( epfd, EPOLL_CTL_ADD, listenfd, &ev );
+    }
+    else
+    {
+        for( i = 0 ; i < nstates ; i ++ ) spawn( states[i] );
+    }
+
+    /* main loop */
+    if( mainloop.u != NULL ) ring_loop();
+    for(;;)
+    {
+        n = epoll_wait( epfd, evs, 16, -1 );
+        mainloop.waits ++;
+        dispatch( evs, n, sigfd );
     }
     exit(0);
 }
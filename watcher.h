@@ -6,18 +6,60 @@
     -h         : show help
     -t #t.#s   : if command terminate #t count in #s second,
                  send log message. ( default is 10count / 10sec )
+    -e #tau:#r : if average crash rate ( time constant #tau sec ) exceed
+                 #r count / min, sleep.
+    -b #r:#n   : allow #r restarts / min, burst #n. ( token bucket )
     -f #       : set syslog facility LOCAL# ( # = 0-7 )
     -l logfile : write stdout/stderr message to logfile.
+    -w #       : use # threads for logging. ( default 1 )
+    -H list    : pin logging threads to cpus in list.
+    -F dest[:out[:err]] : forward stdout/stderr lines to dest ( syslog or
+                 journal ) with priority out / err. ( e.g. local0.info )
+    -R #b[:#n][,#l[:#n]] : limit logging to #b bytes / sec and #l lines / sec,
+                 burst #n. over the limit is discarded and summarized.
+    -c list    : run command on cpus in list. ( e.g. 0-3,8 )
+    -c spread[:list] : one cpu for each instance.
+    -c nodes   : one NUMA node for each instance.
+    -m policy[:nodes] : NUMA memory policy. ( bind/interleave/preferred/local )
+    -S policy[:prio]  : scheduling policy. ( other/batch/idle/fifo/rr )
+    -N #       : nice value of command.
+    -i class[:#] : I/O priority of command. ( rt/be/idle )
+    -o #       : oom_score_adj of command.
+    -n #       : keep # instances of command running. ( pool mode )
+    -L [addr:]port : listen and pass the socket to command as fd 3.
+    -A #       : start command on the first connection ( with -L ),
+                 stop it after # sec without activity. ( 0 = never )
+    -T socket  : live output of command to subscribers on socket. ( with -l or -F )
+    -M         : hardened, lock memory and avoid the OOM killer.
+    -C file    : run the services in file ( instead of command ), started in
+                 dependency order. see depgraph.h for the format.
+    -P #       : start at most # services at once. ( with -C, 0 = no limit )
+    -Q spec    : hold restarts while the host is under pressure. see psi.h.
+    -I         : critical, restarted even under pressure. ( with -Q )
+    -D #[:dir] : keep the last # KB of output, dumped on abnormal termination.
+                 to syslog, or mapped on dir/name.tail and dumped to dir/name.crash.
+    -U         : log threads and main loop on io_uring. ( epoll if the kernel can't )
+    -B #       : shared memory log ring of # KB for each instance. see shmlog.h.
     -p pidfile : write PID to logfile.
+    -j journal : record process lifecycle to journal file. ( journal.name
+                 for each service with -C )
     -s #       : set sleep time # second.
     --         : end marker.
  */
 #include <stdio.h>
 #include <time.h>
+#include <stdint.h>
+#include "rate.h"
+#include "placement.h"
+#include "twheel.h"
 
 #define DEFAULT_REGION 10 /* 10sec */
 #define DEFAULT_COUNT  10 /* 10count  */
 #define DEFAULT_SLEEP  30 /* 30sec */
+#define RESTART_DELAY  RATE_SEC  /* from exit to restart, at least */
+#define READY_POLL     ( 50 * 1000000LL )  /* readiness probe interval */
+#define READY_WARN     ( 60 * RATE_SEC )   /* complain if not ready by then */
+#define MAX_INSTANCES  1024
 
 
 struct watcher_conf {
@@ -25,6 +67,14 @@ struct watcher_conf {
         time_t  region;
         int     count ;
     } alert;
+    struct {
+        double  tau;    /* sec */
+        double  limit;  /* count / min */
+    } ewma;
+    struct {
+        double  rate;   /* count / min */
+        double  burst;
+    } bucket;
     struct {
         int facility;
         int level;  
@@ -33,18 +83,73 @@ struct watcher_conf {
     int uid ; int gid ;
 
     time_t  sleeptime ;
+    int     logworkers;
+    struct {
+        double  bytes;  /* bytes / sec, 0 is unlimited */
+        double  bburst;
+        double  lines;  /* lines / sec, 0 is unlimited */
+        double  lburst;
+    } loglimit;
+    int     forward;    /* LOGFWD_SYSLOG / LOGFWD_JOURNAL, 0 if not */
+    int     outprio;    /* of forwarded stdout */
+    int     errprio;    /* of forwarded stderr */
 
     char  *logfile  ;
     char  *pidfile  ;
+    char  *journal  ;
+    struct placement place;        /* of the child */
+    struct cpumask   housekeeping; /* of logging threads */
+    int    instances;  /* pool mode if > 1 */
+    char  *listen   ;
+    int    lazy     ;  /* on-demand activation */
+    time_t idletime ;
+    char  *tap      ;  /* live log socket */
+    int    hardened ;  /* -M */
+    char  *services ;  /* config file of services, -C */
+    int    parallel ;  /* services starting at once, 0 is unlimited */
+    char  *pressure ;  /* PSI thresholds, -Q */
+    int    critical ;  /* not held by pressure, -I */
+    int    tailsize ;  /* crash tail, KB. 0 if none */
+    char  *taildir  ;  /* mapped, or NULL */
+    int    uring    ;  /* log threads and main loop on io_uring, -U */
+    int    shmlog   ;  /* shared memory log ring, KB. 0 if none, -B */
     char  *progname ;
     int    argc;
     char  *argv[4];
 };
 
+struct journal;
+struct logpipe;
+struct loglimit;
+struct supervisor;
+
+/* one for each instance */
 struct watcher_state {
+    const struct watcher_conf *config;
+    int    index;            /* instance index, 0 origin */
+    pid_t  pid;              /* 0 if not running */
+    int    pidfd;            /* polled by the main ring, -1 if not */
+    int    polled;           /* pidfd poll is submitted */
+    int    stopping;         /* stopped by watcher, not restarted */
+    char   tag[16];          /* " #index" in pool mode */
+    char **envp;
+    char  *pidslot;          /* LISTEN_PID=, filled by the child */
+    struct logpipe *outlp, *errlp, *shmlp;
+    struct supervisor  *sv;       /* policy, supervise.h */
+    struct twheel_timer restart;  /* due, by the supervisor */
+    struct twheel_timer ready;    /* readiness probe, -C */
+    struct journal *journal; /* NULL if not journaling */
+    int64_t starttime;       /* CLOCK_MONOTONIC nsec at fork */
+    int64_t due;             /* restart is due, 0 if not */
+    int64_t held;            /* restart held by pressure since, 0 if not */
+    struct crashtail *tail;  /* NULL if no -D */
+    struct shmlog *shm;      /* NULL if no -B */
+    struct loglimit *limit;  /* NULL if no -R */
     int    wstatus;
-    int    length; /* count x 3 */
-    int    last_slot;
-    time_t crashtimes[1]; 
+    int    execerr;          /* exec failures in a row */
+    int    execfail;         /* exec of this run failed */
+    struct rate_window *window; /* NULL if -t 0 */
+    struct rate_ewma    ewma;
+    struct rate_bucket  bucket;
 };
 
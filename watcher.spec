@@ -21,6 +21,8 @@ make
 rm -fr $RPM_BUILD_ROOT
 mkdir -p $RPM_BUILD_ROOT/usr/local/bin
 cp -pr ./watcher $RPM_BUILD_ROOT/usr/local/bin/
+cp -pr ./wjournal $RPM_BUILD_ROOT/usr/local/bin/
+cp -pr ./wtail $RPM_BUILD_ROOT/usr/local/bin/
 
 %clean
 rm -rf $RPM_BUILD_ROOT
@@ -36,3 +38,5 @@ rm -rf $RPM_BUILD_ROOT
 %files
 %doc COPYING.GPL
 /usr/local/bin/watcher
+/usr/local/bin/wjournal
+/usr/local/bin/wtail
@@ -0,0 +1,118 @@
+/*
+ * wjournal.c : dump the lifecycle journal of watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ *  usage : wjournal [ -h ] [ -n # ] [ -p # ] [ -g # ] [ -i # ] [ -s # ] [ -a ] journal
+ *
+ *    -n #  : show last # records only.
+ *    -p #  : show records of pid # only.
+ *    -g #  : show records of watcher generation # only.
+ *    -i #  : show records of instance # only.
+ *    -s #  : show records of last # seconds only.
+ *    -a    : show abnormal terminations only.
+ */
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+
+static void show_help( const char *name, int exval )
+{
+    fprintf( stderr, "usage : %s [ -h ] [ -n # ] [ -p # ] [ -g # ] [ -i # ] [ -s # ] [ -a ] journal\n"
+                     "\t -h    : show this help ( and terminate. )\n"
+                     "\t -n #  : show last # records only.\n"
+                     "\t -p #  : show records of pid # only.\n"
+                     "\t -g #  : show records of watcher generation # only.\n"
+                     "\t -i #  : show records of instance # only.\n"
+                     "\t -s #  : show records of last # seconds only.\n"
+                     "\t -a    : show abnormal terminations only.\n"
+                     "\n", name );
+    exit( exval );
+}
+
+static int abnormal( int wstatus )
+{
+    return WIFSIGNALED( wstatus )
+        || ( WIFEXITED( wstatus ) && WEXITSTATUS( wstatus ) != 0 );
+}
+
+static void print_rec( FILE *fp, uint64_t index, const struct journal_rec *r )
+{
+    char      tbuff[64];
+    char      sbuff[32];
+    time_t    t = r->wall_ns / 1000000000LL;
+    struct tm tm;
+
+    strftime( tbuff, sizeof( tbuff ), "%Y-%m-%d %H:%M:%S", localtime_r( &t, &tm ) );
+    if( WIFSIGNALED( r->wstatus ) )
+        snprintf( sbuff, sizeof( sbuff ), "signal %d%s", WTERMSIG( r->wstatus ),
+                  WCOREDUMP( r->wstatus ) ? " (core)" : "" );
+    else
+        snprintf( sbuff, sizeof( sbuff ), "exit %d", WEXITSTATUS( r->wstatus ) );
+
+    fprintf( fp, "%8llu %s.%03d gen %-4u #%-3d pid %-7d %-16s run %.3fs\n",
+             (unsigned long long)index, tbuff, (int)( ( r->wall_ns / 1000000 ) % 1000 ),
+             r->generation, r->instance, r->pid, sbuff, r->run_ns / 1e9 );
+}
+
+int main( int argc, char *argv[] )
+{
+    struct journal *j;
+    int      c, i, len;
+    int      last = -1, pid = -1, gen = -1, inst = -1, since = -1, abnormal_only = 0;
+    int64_t  limit = 0;
+
+    while( (c = getopt( argc, argv, "hn:p:g:i:s:a")) != EOF )
+    {
+        switch( c )
+        {
+        case 'n': last  = atoi( optarg ); break;
+        case 'p': pid   = atoi( optarg ); break;
+        case 'g': gen   = atoi( optarg ); break;
+        case 'i': inst  = atoi( optarg ); break;
+        case 's': since = atoi( optarg ); break;
+        case 'a': abnormal_only = 1;      break;
+        case '?':
+        case 'h':
+            show_help( argv[0], 6 );
+        }
+    }
+    if( optind >= argc ) show_help( argv[0], 6 );
+
+    j = journal_open( argv[optind], 0, 0 );
+    if( j == NULL )
+    {
+        fprintf( stderr, "can't open journal '%s', %s\n", argv[optind], strerror( errno ) );
+        exit( 2 );
+    }
+    if( since >= 0 )
+        limit = journal_now( CLOCK_REALTIME ) - (int64_t)since * 1000000000LL;
+
+    len = journal_length( j );
+    if( last >= 0 && last < len ) len = last;
+
+    for( i = len -1 ; i >= 0 ; i -- ) // oldest first
+    {
+        const struct journal_rec *r = journal_get( j, i );
+
+        if( pid >= 0 && r->pid != pid ) continue;
+        if( gen >= 0 && r->generation != (uint32_t)gen ) continue;
+        if( inst >= 0 && r->instance != inst ) continue;
+        if( since >= 0 && r->wall_ns < limit ) continue;
+        if( abnormal_only && !abnormal( r->wstatus ) ) continue;
+
+        print_rec( stdout, j->head->count - 1 - i, r );
+    }
+    journal_close( j );
+    exit( 0 );
+}
@@ -0,0 +1,319 @@
+/*
+ * wsim.c : simulate the supervision policy of watcher at scale.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ *  usage : wsim [ -h ] [ -n # ] [ -d # ] [ -c dist ] [ -l #f[:dist] ] [ -r # ] [ -v ]
+ *               [ -t #t.#s ] [ -e #tau:#r ] [ -b #r:#n ] [ -s # ]
+ *
+ *    -n #     : services. ( default 10000 )
+ *    -d #     : days to simulate. ( default 7 )
+ *    -c dist  : run time of a healthy service until it crashes.
+ *               ( default exp:86400, a crash a day )
+ *    -l #f[:dist] : fraction #f of the services is broken, crashes after
+ *               dist. ( default 0.01:exp:0.1 )
+ *    -r #     : seed of the random numbers. ( default 1 )
+ *    -v       : show the log of the supervisor. ( -vv : with debug )
+ *    -t -e -b -s : the policy, as watcher.
+ *
+ *    dist : exp:mean | weibull:shape:scale | fixed:sec | uniform:min:max ( sec )
+ *
+ *  the supervision core ( supervise.c ) and the timer wheel of watcher
+ *  run on a virtual clock, children are timers that crash after a random
+ *  run time. the same seed gives the same run, the digest of the
+ *  outcome changes only if the policy decides otherwise.
+ */
+#include "watcher.h"
+#include "supervise.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <syslog.h>
+
+#define DIST_EXP      1
+#define DIST_WEIBULL  2
+#define DIST_FIXED    3
+#define DIST_UNIFORM  4
+
+struct dist {
+    int    type;
+    double a, b;
+};
+
+/* a synthetic child */
+struct simsvc {
+    struct watcher_state state;
+    struct twheel_timer  crash;
+    int      broken;
+    int      sleeps;       /* restarts delayed by the policy */
+    int64_t  detected;     /* the first sleep, 0 if none */
+    int64_t  up;           /* run time, nsec */
+};
+
+static struct twheel     wheel;
+static struct supervisor sv;
+static int64_t           vnow;       /* the virtual clock */
+static int64_t           end;
+static uint64_t          seed = 1;
+static int               verbose = 0;
+static int               pids = 0;
+static uint64_t          logs = 0;
+static struct dist       healthy = { DIST_EXP, 86400.0, 0.0 };
+static struct dist       broken  = { DIST_EXP, 0.1, 0.0 };
+
+static void show_help( const char *name, int exval )
+{
+    fprintf( stderr, "usage : %s [ -h ] [ -n # ] [ -d # ] [ -c dist ] [ -l #f[:dist] ] [ -r # ] [ -v ]\n"
+                     "            [ -t #t.#s ] [ -e #tau:#r ] [ -b #r:#n ] [ -s # ]\n"
+                     "\t -h     : show this help ( and terminate. )\n"
+                     "\t -n #   : services. ( default 10000 )\n"
+                     "\t -d #   : days to simulate. ( default 7 )\n"
+                     "\t -c dist: run time of a healthy service until it crashes. ( default exp:86400 )\n"
+                     "\t -l #f[:dist] : fraction #f of the services crash after dist. ( default 0.01:exp:0.1 )\n"
+                     "\t -r #   : seed of the random numbers. ( default 1 )\n"
+                     "\t -v     : show the log of the supervisor. ( -vv : with debug )\n"
+                     "\t -t -e -b -s : the policy, as watcher.\n"
+                     "\t dist   : exp:mean | weibull:shape:scale | fixed:sec | uniform:min:max ( sec )\n"
+                     "\n", name );
+    exit( exval );
+}
+
+/*
+ * xorshift64*, the same on any libc.
+ */
+static double uniform( void )
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return ( ( ( seed * 0x2545F4914F6CDD1DULL ) >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 ); // (0,1]
+}
+
+static int64_t draw( const struct dist *d )
+{
+    double sec = 0.0;
+
+    switch( d->type )
+    {
+    case DIST_EXP:     sec = -d->a * log( uniform() ); break;
+    case DIST_WEIBULL: sec = d->b * pow( -log( uniform() ), 1.0 / d->a ); break;
+    case DIST_FIXED:   sec = d->a; break;
+    case DIST_UNIFORM: sec = d->a + ( d->b - d->a ) * uniform(); break;
+    }
+    return (int64_t)( sec * RATE_SEC );
+}
+
+static int parse_dist( const char *spec, struct dist *d )
+{
+    const char *p = strchr( spec, ':' );
+    int         n;
+
+    if( p == NULL ) return -1;
+    n = sscanf( p + 1, "%lf:%lf", &( d->a ), &( d->b ) );
+    if( strncmp( spec, "exp:", 4 ) == 0 && n >= 1 )          d->type = DIST_EXP;
+    else if( strncmp( spec, "weibull:", 8 ) == 0 && n == 2 ) d->type = DIST_WEIBULL;
+    else if( strncmp( spec, "fixed:", 6 ) == 0 && n >= 1 )   d->type = DIST_FIXED;
+    else if( strncmp( spec, "uniform:", 8 ) == 0 && n == 2 ) d->type = DIST_UNIFORM;
+    else return -1;
+    return ( d->a > 0.0 || ( d->type == DIST_UNIFORM && d->a >= 0.0 && d->b > d->a ) ) ? 0 : -1;
+}
+
+static int64_t sim_now( struct supervisor *s )
+{
+    return vnow;
+}
+
+/*
+ * the spawner : the child runs until its crash timer.
+ */
+static void sim_start( struct supervisor *s, struct watcher_state *state )
+{
+    struct simsvc *svc = (struct simsvc *)state;
+    int64_t        run = draw( svc->broken ? &broken : &healthy );
+
+    state->pid       = ++pids;
+    state->starttime = vnow;
+    state->due       = 0;
+    if( vnow + run < end ) twheel_add( &wheel, &( svc->crash ), vnow + run );
+}
+
+static void sim_log( struct supervisor *s, int prio, const char *msg )
+{
+    logs ++;
+    if( verbose )
+        fprintf( stderr, "%12.3f %s\n", vnow / 1e9, msg );
+}
+
+static const struct supervisor_ops sim_ops = { sim_now, sim_start, sim_log };
+
+static void crashed( struct twheel *w, struct twheel_timer *t, void *arg )
+{
+    struct simsvc *svc = arg;
+
+    svc->up += vnow - svc->state.starttime;
+    svc->state.pid     = 0;
+    svc->state.wstatus = 1 << 8; // exit 1
+    if( supervise_exited( &sv, &( svc->state ) ) )
+    {
+        svc->sleeps ++;
+        if( svc->detected == 0 ) svc->detected = vnow;
+    }
+}
+
+static int64_t cputime( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t walltime( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main( int argc, char *argv[] )
+{
+    struct watcher_conf conf;
+    struct simsvc      *svcs;
+    double   days = 7.0, frac = 0.01, up[2] = { 0.0, 0.0 }, lat = 0.0, latmax = 0.0;
+    int      c, i, n = 10000, nsvc[2] = { 0, 0 }, slept[2] = { 0, 0 }, detected = 0;
+    uint64_t events = 0, digest = 14695981039346656037ULL;
+    int64_t  next, cpu, wall;
+    char    *p;
+
+    memset( &conf, 0x00, sizeof( conf ) );
+    conf.alert.region = DEFAULT_REGION;
+    conf.alert.count  = DEFAULT_COUNT;
+    conf.sleeptime    = DEFAULT_SLEEP;
+    conf.instances    = 1;
+    conf.progname     = "sim";
+
+    while( ( c = getopt( argc, argv, "hn:d:c:l:r:vt:e:b:s:" ) ) != EOF )
+    {
+        switch( c )
+        {
+        case 'n': n    = atoi( optarg ); break;
+        case 'd': days = atof( optarg ); break;
+        case 'r': seed = strtoull( optarg, NULL, 0 ); break;
+        case 'v': verbose ++; break;
+        case 'c':
+            if( parse_dist( optarg, &healthy ) < 0 ) show_help( argv[0], 1 );
+            break;
+        case 'l':
+            frac = atof( optarg );
+            if( ( p = strchr( optarg, ':' ) ) != NULL && parse_dist( p + 1, &broken ) < 0 )
+                show_help( argv[0], 1 );
+            break;
+        case 't': // as watcher
+            conf.alert.count = atoi( optarg );
+            if( ( p = strchr( optarg, '.' ) ) != NULL ) conf.alert.region = atoi( p+1 );
+            break;
+        case 'e':
+            conf.ewma.tau = atof( optarg );
+            if( ( p = strchr( optarg, ':' ) ) != NULL ) conf.ewma.limit = atof( p+1 );
+            break;
+        case 'b':
+            conf.bucket.rate = atof( optarg );
+            p = strchr( optarg, ':' );
+            conf.bucket.burst = ( p != NULL ) ? atof( p+1 ) : 1.0 ;
+            break;
+        case 's': conf.sleeptime = atoi( optarg ); break;
+        case 'h':
+        default : show_help( argv[0], c != 'h' );
+        }
+    }
+    // the wheel reaches 2^32 ticks ahead.
+    if( n < 1 || days <= 0.0 || days > 45.0 || frac < 0.0 || frac > 1.0 || seed == 0 )
+        show_help( argv[0], 1 );
+
+    end  = (int64_t)( days * 86400.0 ) * RATE_SEC;
+    svcs = calloc( sizeof( struct simsvc ), n );
+    if( svcs == NULL || twheel_init( &wheel, TWHEEL_TICK, 0, 0 ) < 0 )
+    {
+        perror( "wsim" );
+        return 1;
+    }
+    supervise_init( &sv, &sim_ops, NULL, &wheel );
+    sv.debug = ( verbose > 1 );
+
+    printf( "%d services ( %.2f %% broken ) for %.1f days, seed %llu.\n",
+            n, frac * 100.0, days, (unsigned long long)seed );
+    printf( "policy : -t %d.%d -e %g:%g -b %g:%g -s %d\n", conf.alert.count, (int)conf.alert.region,
+            conf.ewma.tau, conf.ewma.limit, conf.bucket.rate, conf.bucket.burst, (int)conf.sleeptime );
+
+    cpu  = cputime();
+    wall = walltime();
+    for( i = 0 ; i < n ; i ++ )
+    {
+        svcs[i].state.config = &conf;
+        svcs[i].state.index  = i;
+        svcs[i].broken       = ( uniform() <= frac );
+        if( supervise_state( &sv, &( svcs[i].state ) ) < 0 )
+        {
+            perror( "wsim" );
+            return 1;
+        }
+        twheel_timer_init( &( svcs[i].crash ), crashed, &svcs[i] );
+        sim_start( &sv, &( svcs[i].state ) );
+    }
+    while( ( next = twheel_next( &wheel ) ) >= 0 && next <= end )
+    {
+        vnow    = next;
+        events += twheel_advance( &wheel, vnow );
+    }
+    vnow = end;
+    cpu  = cputime() - cpu;
+    wall = walltime() - wall;
+
+    for( i = 0 ; i < n ; i ++ )
+    {
+        struct simsvc *s = &svcs[i];
+        int64_t d;
+
+        if( s->state.pid != 0 ) s->up += end - s->state.starttime;
+        up[s->broken]   += (double)s->up / end;
+        nsvc[s->broken] ++;
+        slept[s->broken] += ( s->sleeps > 0 );
+        if( s->broken && s->detected != 0 )
+        {
+            d = s->detected;
+            detected ++;
+            lat += d / 1e9;
+            if( d / 1e9 > latmax ) latmax = d / 1e9;
+        }
+        // FNV-1a of what the policy decided.
+        digest = ( digest ^ (uint64_t)s->state.pid ) * 1099511628211ULL;
+        digest = ( digest ^ (uint64_t)s->sleeps ) * 1099511628211ULL;
+        digest = ( digest ^ (uint64_t)s->up ) * 1099511628211ULL;
+    }
+
+    printf( "simulated %.0f sec in %.3f sec ( %.0fx ), %llu events, supervisor cpu %.0f nsec / event.\n",
+            end / 1e9, wall / 1e9, (double)end / wall, (unsigned long long)events,
+            events ? (double)cpu / events : 0.0 );
+    printf( "exits %llu ( %llu abnormal ), restarts %llu, slept by window %llu, ewma %llu, bucket %llu,"
+            " %llu log messages.\n",
+            (unsigned long long)sv.stat.exits, (unsigned long long)sv.stat.abnormal,
+            (unsigned long long)sv.stat.restarts, (unsigned long long)sv.stat.window,
+            (unsigned long long)sv.stat.ewma, (unsigned long long)sv.stat.bucket,
+            (unsigned long long)logs );
+    if( nsvc[0] > 0 )
+        printf( "healthy : %d, availability %.4f %%, %d slept ( false positive ).\n",
+                nsvc[0], up[0] * 100.0 / nsvc[0], slept[0] );
+    if( nsvc[1] > 0 )
+        printf( "broken  : %d, availability %.4f %%, %d detected, after %.1f sec avg, %.1f sec max.\n",
+                nsvc[1], up[1] * 100.0 / nsvc[1], detected, detected ? lat / detected : 0.0, latmax );
+    printf( "digest %016llx\n", (unsigned long long)digest );
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * wtail.c : follow the live output of the children of watcher.
+ *
+ * Copyright(c)2001 SHIROYAMA Takayuki <shiro@installer.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ *  usage : wtail [ -h ] socket
+ *
+ *    socket : tap socket of watcher ( -T ).
+ *
+ *  terminates when watcher drops it ( too slow ) or terminates.
+ */
+#define _GNU_SOURCE
+#include "logtap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+static void show_help( const char *name, int exval )
+{
+    fprintf( stderr, "usage : %s [ -h ] socket\n"
+                     "\t -h     : show this help ( and terminate. )\n"
+                     "\t socket : tap socket of watcher ( -T ).\n"
+                     "\n", name );
+    exit( exval );
+}
+
+int main( int argc, char *argv[] )
+{
+    char    buff[65536];
+    ssize_t siz;
+    int     c, fd, usesplice = 1;
+
+    while( (c = getopt( argc, argv, "h")) != EOF )
+    {
+        switch( c )
+        {
+        case '?':
+        case 'h':
+            show_help( argv[0], 6 );
+        }
+    }
+    if( optind >= argc ) show_help( argv[0], 6 );
+
+    fd = logtap_connect( argv[optind] );
+    if( fd < 0 )
+    {
+        fprintf( stderr, "can't subscribe to '%s', %s\n", argv[optind], strerror( errno ) );
+        exit( 2 );
+    }
+
+    for(;;)
+    {
+        if( usesplice )
+        {
+            siz = splice( fd, NULL, 1, NULL, sizeof( buff ), SPLICE_F_MOVE );
+            if( siz < 0 && errno == EINVAL ) // stdout can't be spliced into.
+            {
+                usesplice = 0;
+                continue;
+            }
+        }
+        else
+        {
+            siz = read( fd, buff, sizeof( buff ) );
+            if( siz > 0 && write( 1, buff, siz ) != siz ) siz = -1;
+        }
+        if( siz < 0 && errno == EINTR ) continue;
+        if( siz <= 0 ) break;
+    }
+    exit( siz < 0 ? 1 : 0 );
+}